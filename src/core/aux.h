@@ -39,6 +39,7 @@ namespace Silence {
     const double TANPIOVER6 = 0.57735;
 
     const int    PENUMBRAIP = 4; // How many iterations of faux interpolation to perform in the penumbra
+    const int    PACKETSIZE = 8; // How many eye Rays to intersect at once (4, 8 and 16 suit SSE, AVX and AVX-512 respectively)
 
     inline double  abs( double x )           { return x < 0 ? -x : x; }
     inline double sign( double x )           { return x < 0 ? -1 : x == 0 ? 0 : 1; }
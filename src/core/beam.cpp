@@ -24,11 +24,13 @@
 
 #include "camera.h"
 #include "scene.h"
+#include "stats.h"
 
 namespace Silence {
 
     bool Beam::contains( const Vector& point ) const
     {
+        Stats::count( Stats::BEAM_CONTAINS );
         const Vector direction = point - apex;
         if ( pivot.getDirection() * direction < 0 )
             return false;
@@ -61,6 +63,7 @@ namespace Silence {
 
     bool Beam::containsNew( const Vector& point ) const
     {
+        Stats::count( Stats::BEAM_CONTAINS_NEW );
         const Vector direction = point - apex;
         if ( pivot.getDirection() * direction < 0 )
             return false;
@@ -22,6 +22,9 @@
 
 #include "camera.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <limits>
 
 #include "scene.h"
@@ -33,17 +36,185 @@ namespace Silence {
         os << "( " << screenpoint.col << ", " << screenpoint.row << ")"; return os;
     }
 
+    // Rows start on cache line boundaries so they can be processed with aligned vector instructions
+    static const int cacheLine = 64;
+    static const int rowAlign  = cacheLine / sizeof(float); // Any multiple of this many pixels will do
+
+    // Get a block of memory aligned to a cache line
+    static float* allocateAligned( size_t count )
+    {
+        char* raw = (char*)std::malloc( count * sizeof(float) + cacheLine + sizeof(void*) );
+        if ( !raw )
+            throw std::string("out of memory for pixels");
+        char* aligned = raw + sizeof(void*);
+        aligned += cacheLine - (size_t)aligned % cacheLine;
+        ((void**)aligned)[-1] = raw; // Remember the original address
+        return (float*)aligned;
+    }
+
+    static void freeAligned( float* block )
+    {
+        if ( block )
+            std::free( ((void**)block)[-1] );
+    }
+
     // Reset pixel buffer to all black
+    void Framebuffer::clear()
+    {
+        // The Sky plane follows the pixels directly
+        float* const begin = pixels;
+        float* const end   = pixels + 4 * stride * height;
+        #pragma omp simd
+        for ( float* p = begin; p < end; ++p )
+            *p = 0;
+    }
+
+    // Fill in the pixels where the Sky is showing through, squash values into (0, 0, 0)..(1, 1, 1)
+    // unless told otherwise and apply gamma correction, all in a single pass.
+    // The image must have the same layout as our pixels
+    void Framebuffer::resolve( const RGB& sky, double gamma, float* image, bool clamp ) const
+    {
+        const float skyColor[3] = { (float)sky.x, (float)sky.y, (float)sky.z };
+        const float exponent    = 1 / gamma;
+        const bool  correct     = !equal( 1, gamma );
+        #pragma omp parallel for
+        for ( int row = 0; row < height; ++row )
+        {
+            const float* linear = getRow( row );
+            const float* cover  = getSkyRow( row );
+            float*       out    = image + 3 * stride * row;
+            #pragma omp simd
+            for ( int col = 0; col < width; ++col )
+            {
+                const float skyMask = std::max( 0.0f, 1 - cover[col] );
+                out[3*col + 0] = linear[3*col + 0] + skyColor[0] * skyMask;
+                out[3*col + 1] = linear[3*col + 1] + skyColor[1] * skyMask;
+                out[3*col + 2] = linear[3*col + 2] + skyColor[2] * skyMask;
+            }
+            if ( clamp )
+                for ( int i = 0; i < 3 * width; ++i )
+                    out[i] = std::min( 1.0f, out[i] );
+            if ( correct )
+                for ( int i = 0; i < 3 * width; ++i )
+                    out[i] = std::pow( out[i], exponent );
+        }
+    }
+
+    Camera::~Camera()
+    {
+        freeAligned( arena );
+    }
+
+    // Carve out every Framebuffer and the image from one block of memory
+    void Camera::allocate()
+    {
+        assert( !rendering );
+        const int width     = cropWidth  ? cropWidth  : screen.gridwidth;
+        const int height    = cropHeight ? cropHeight : screen.gridheight;
+        const int stride    = (width + rowAlign - 1) / rowAlign * rowAlign;
+        const size_t plane  = (size_t)stride * height;
+        const size_t frames = 1 + levels.size() + lights.size() + costMapped;
+        freeAligned( arena );
+        arena = allocateAligned( frames * 4 * plane + 3 * plane );
+        float* next = arena;
+        Framebuffer* const buffers[4] = { &frame, levels.empty() ? NULL : &levels[0], lights.empty() ? NULL : &lights[0], &costs };
+        const size_t counts[4] = { 1, levels.size(), lights.size(), costMapped };
+        for ( int i = 0; i < 4; ++i )
+            for ( size_t j = 0; j < counts[i]; ++j )
+            {
+                Framebuffer& buffer = buffers[i][j];
+                buffer.width    = width;
+                buffer.height   = height;
+                buffer.stride   = stride;
+                buffer.pixels   = next;
+                buffer.skyCover = next + 3 * plane;
+                buffer.clear();
+                next += 4 * plane;
+            }
+        image = next;
+        std::fill( image, image + 3 * plane, 0.0f );
+    }
+
+    // Reset pixel buffers to all black
     void Camera::clear()
     {
         assert( !rendering );
-        #pragma omp parallel for
-        for ( int row = 0; row < screen.gridheight; ++row )
-            for ( int col = 0; col < screen.gridwidth; ++col )
+        frame.clear();
+        for ( std::vector< Framebuffer >::iterator level = levels.begin(); level != levels.end(); level++ )
+            level->clear();
+        for ( std::vector< Framebuffer >::iterator light = lights.begin(); light != lights.end(); light++ )
+            light->clear();
+        if ( costMapped )
+            costs.clear();
+    }
+
+    void Camera::resolve( double gamma )
+    {
+        assert( !rendering );
+        this->gamma = gamma;
+        frame.resolve( scene->getSky().color, gamma, image );
+    }
+
+    // Changing the number of Framebuffers discards all pixels
+    void Camera::setLevelCount( int count )
+    {
+        assert( !rendering && 0 <= count );
+        if ( count == (int)levels.size() )
+            return;
+        levels.resize( count );
+        allocate();
+    }
+
+    void Camera::setLightCount( int count )
+    {
+        assert( !rendering && 0 <= count );
+        if ( count == (int)lights.size() )
+            return;
+        lights.resize( count );
+        allocate();
+    }
+
+    void Camera::setCostMap( bool on )
+    {
+        assert( !rendering );
+        if ( on == costMapped )
+            return;
+        costMapped = on;
+        if ( !on )
+            costs = Framebuffer();
+        allocate();
+    }
+
+    // Zones are linear in their Light's emission so the image can be rebuilt without rendering again
+    void Camera::relight( const std::vector< Triplet >& scales, double gamma )
+    {
+        assert( !rendering );
+        assert( scales.size() == lights.size() );
+        frame.clear();
+        for ( unsigned int i = 0; i < lights.size(); ++i )
+        {
+            if ( RGB::Black == scales[i] )
+                continue; // Switched off: it's as if it had no Zones at all
+            const float scale[3] = { (float)scales[i].x, (float)scales[i].y, (float)scales[i].z };
+            const Framebuffer& light = lights[i];
+            #pragma omp parallel for
+            for ( int row = 0; row < frame.height; ++row )
             {
-                pixels [row][col] = RGB::Black;
-                skyMask[row][col] = 1;
+                const float* from     = light.getRow( row );
+                const float* fromSky  = light.getSkyRow( row );
+                float*       to       = frame.getRow( row );
+                float*       toSky    = frame.getSkyRow( row );
+                #pragma omp simd
+                for ( int col = 0; col < frame.width; ++col )
+                {
+                    to[3*col + 0] += from[3*col + 0] * scale[0];
+                    to[3*col + 1] += from[3*col + 1] * scale[1];
+                    to[3*col + 2] += from[3*col + 2] * scale[2];
+                    toSky[col]    += fromSky[col];
+                }
             }
+        }
+        resolve( gamma );
     }
 
     // Return the dummy Plane the Screen lies on
@@ -102,43 +273,131 @@ namespace Silence {
         return 0 < apexToScreen * viewpointToScreen;
     }
 
-    // Fill in the pixels where the Sky is showing through
-    void Camera::paintSky()
+    // Write rendering results to character stream in the chosen image format.
+    // PFM gets the linear values as they are, the rest get the final image
+    void Camera::writePixels( std::ostream& os, ImageFormat format, int level ) const
     {
         assert( !rendering );
-        #pragma omp parallel for
-        for ( int row = 0; row < screen.gridheight; ++row )
-            for ( int col = 0; col < screen.gridwidth; ++col )
-                if ( 0 < skyMask[row][col] )
-                    pixels[row][col] += scene->getSky().color * skyMask[row][col];
+        assert( level < (int)levels.size() );
+        if ( modeFlags.verbose )
+            std::cerr << "Camera: writing pixels to stream... ";
+        const Framebuffer& source = -1 == level ? frame : levels[level];
+        std::vector< float > resolved;
+        const float* pixels = image;
+        if ( IMAGE_PFM == format || -1 != level )
+        {
+            resolved.resize( 3 * frame.stride * frame.height );
+            if ( IMAGE_PFM == format )
+                source.resolve( scene->getSky().color, 1, &resolved[0], false );
+            else
+                source.resolve( scene->getSky().color, gamma, &resolved[0] );
+            pixels = &resolved[0];
+        }
+        writeImage( os, format, pixels, frame.width, frame.height, frame.stride );
+        if ( modeFlags.verbose )
+            std::cerr << "done." << std::endl;
+    }
+
+    void Camera::writeCostMap( std::ostream& os ) const
+    {
+        assert( !rendering && costMapped );
+        writePFM( os, costs.pixels, costs.width, costs.height, costs.stride );
     }
 
-    void Camera::gammaCorrect( double gamma )
+    // The format is modeled on PFM: a "SF" line, the size, the byte order, then the rows top down,
+    // each one holding the RGB values followed by the Sky coverage values
+    void Camera::writeFramebuffer( std::ostream& os ) const
     {
         assert( !rendering );
-        if ( equal(1, gamma) )
-            return;
-        #pragma omp parallel for
-        for ( int row = 0; row < screen.gridheight; ++row )
-            for ( int col = 0; col < screen.gridwidth; ++col )
-                pixels[row][col].gamma( gamma );
+        const unsigned int one = 1;
+        const bool littleEndian = 1 == *(const unsigned char*)&one;
+        os << "SF\n" << frame.width << " " << frame.height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+        for ( int row = 0; row < frame.height; ++row )
+        {
+            os.write( (const char*)frame.getRow( row ),    3 * frame.width * sizeof(float) );
+            os.write( (const char*)frame.getSkyRow( row ),     frame.width * sizeof(float) );
+        }
     }
 
-    // Write rendering results to character stream in PPM format
-    void Camera::writePixels( std::ostream& os ) const
+    void Camera::addFramebuffer( std::istream& is )
     {
         assert( !rendering );
-        if ( modeFlags.verbose )
-            std::cerr << "Camera: writing pixels to stream... ";
-        os << "P3\n" << screen.gridwidth << " " << screen.gridheight << "\n" << 255 << "\n";
-        for ( int row = 0; row < screen.gridheight; ++row )
-            for ( int col = 0; col < screen.gridwidth; ++col )
-            {
-                Triplet rgb255 = pixels[row][col].project( 0, 255 );
-                os << int(rgb255.x + 0.5) << " " << int(rgb255.y + 0.5) << " " << int(rgb255.z + 0.5) << " ";
-            }
-        if ( modeFlags.verbose )
-            std::cerr << "done." << std::endl;
+        std::string magic;
+        int width, height;
+        double scale;
+        is >> magic >> width >> height >> scale;
+        is.get();
+        if ( !is || "SF" != magic )
+            throw std::string( "not a Framebuffer dump" );
+        if ( width != frame.width || height != frame.height )
+            throw std::string( "the Framebuffer dump is of a different size" );
+        const unsigned int one = 1;
+        const bool littleEndian = 1 == *(const unsigned char*)&one;
+        if ( littleEndian != (scale < 0) )
+            throw std::string( "the Framebuffer dump was written with a different byte order" );
+        std::vector< float > row( 4 * width );
+        for ( int r = 0; r < height; ++r )
+        {
+            if ( !is.read( (char*)&row[0], row.size() * sizeof(float) ) )
+                throw std::string( "the Framebuffer dump ends prematurely" );
+            float* pixels = frame.getRow( r );
+            float* cover  = frame.getSkyRow( r );
+            for ( int i = 0; i < 3 * width; ++i )
+                pixels[i] += row[i];
+            for ( int col = 0; col < width; ++col )
+                cover[col] += row[3 * width + col];
+        }
+    }
+
+    void Camera::readPixels( float* out, bool linear ) const
+    {
+        assert( !rendering );
+        std::vector< float > resolved;
+        const float* pixels = image;
+        if ( linear )
+        {
+            resolved.resize( 3 * frame.stride * frame.height );
+            frame.resolve( scene->getSky().color, 1, &resolved[0], false );
+            pixels = &resolved[0];
+        }
+        // Leave out the padding at the end of the rows
+        for ( int row = 0; row < frame.height; ++row )
+            std::copy( pixels + 3 * frame.stride * row, pixels + 3 * (frame.stride * row + frame.width), out + 3 * frame.width * row );
+    }
+
+    void Camera::setPose( const Camera& other, int divisor )
+    {
+        // A bare pose that doesn't belong to any Scene will do too
+        assert( !rendering && (scene == other.scene || !other.scene) && 0 < divisor );
+        const int width   = (other.screen.gridwidth  + divisor - 1) / divisor;
+        const int height  = (other.screen.gridheight + divisor - 1) / divisor;
+        const bool resize = !arena || cropWidth || screen.gridwidth != width || screen.gridheight != height;
+        cropWidth = cropHeight = 0;
+        viewpoint = other.viewpoint;
+        screen    = other.screen;
+        screen.gridwidth  = width;
+        screen.gridheight = height;
+        if ( resize )
+            allocate();
+    }
+
+    // The Screen stays as it is so the pixels of the rectangle are computed exactly as in the full image
+    void Camera::crop( int x, int y, int width, int height )
+    {
+        assert( !rendering && 0 <= x && 0 <= y && 0 < width && 0 < height );
+        assert( x + width <= screen.gridwidth && y + height <= screen.gridheight );
+        cropX      = x;
+        cropY      = y;
+        cropWidth  = width;
+        cropHeight = height;
+        allocate();
+    }
+
+    const BoundingBox Camera::getCrop() const
+    {
+        if ( !cropWidth )
+            return BoundingBox( ScreenPoint(0, 0), ScreenPoint(screen.gridwidth, screen.gridheight) );
+        return BoundingBox( ScreenPoint(cropX, cropY), ScreenPoint(cropX + cropWidth, cropY + cropHeight) );
     }
 
     // Translate both the viewpoint and the screen in camera space
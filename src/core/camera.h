@@ -25,7 +25,9 @@
 
 #include <fstream>
 #include <iostream>
+#include <vector>
 
+#include "image.h"
 #include "triplet.h"
 #include "zone.h"
 
@@ -52,16 +54,35 @@ namespace Silence {
         ScreenPoint topLeft, bottomRight;
     };
 
+    // Linear light accumulated on the screen. Values are not clamped in any way
+    // until the Framebuffer is resolved into a displayable image.
+    // The memory is owned by the Camera; rows are padded to a whole number of cache lines
+    struct Framebuffer {
+        Framebuffer()
+            : width( 0 )
+            , height( 0 )
+            , stride( 0 )
+            , pixels( NULL )
+            , skyCover( NULL )
+        { }
+
+        void clear();
+        void resolve( const RGB& sky, double gamma, float* image, bool clamp = true ) const; // Add Sky, clamp and correct gamma in one pass
+
+        float* getRow   ( int row ) const { return pixels   + 3 * stride * row; }
+        float* getSkyRow( int row ) const { return skyCover +     stride * row; }
+
+        int    width;
+        int    height;
+        int    stride;   // Pixels allocated per row
+        float* pixels;   // Interleaved linear RGB values, row by row
+        float* skyCover; // How much of the Sky is covered up by Surfaces
+    };
+
     class Camera {
     public:
         enum Axis { AXIS_X, AXIS_Y, AXIS_Z };
 
-        // The GUI's going to need these
-        struct RenderInfo {
-            int  clockError;
-            bool sceneChanged;
-        };
-
     private:
         struct Screen {
             Screen() { }
@@ -83,53 +104,95 @@ namespace Silence {
     public:
         Camera( const Scene* scene )
             : scene( scene )
-            , pixels( NULL )
-            , skyMask( NULL )
+            , arena( NULL )
+            , frame()
+            , levels()
+            , lights()
+            , costs()
+            , image( NULL )
+            , gamma( 1 )
+            , cropX( 0 )
+            , cropY( 0 )
+            , cropWidth( 0 )
+            , cropHeight( 0 )
+            , costMapped( false )
             , rendering( false )
         { }
         Camera( const Scene* scene, Vector viewpoint, Screen screen, int width, int height )
             : scene( scene )
             , viewpoint( viewpoint )
             , screen( screen )
+            , arena( NULL )
+            , frame()
+            , levels()
+            , lights()
+            , costs()
+            , image( NULL )
+            , gamma( 1 )
+            , cropX( 0 )
+            , cropY( 0 )
+            , cropWidth( 0 )
+            , cropHeight( 0 )
+            , costMapped( false )
             , rendering( false )
         {
-            pixels = new RGB*[height];
-            for ( int i = 0; i < height; ++i )
-                pixels[i] = new RGB[width];
-            skyMask = new double*[height];
-            for ( int i = 0; i < height; ++i )
-                skyMask[i] = new double[width];
-        }
-        ~Camera()
-        {
-            if ( pixels )
-            {
-                for ( int i = 0; i < screen.gridheight; ++i )
-                    delete[] pixels[i];
-                delete[] pixels;
-            }
-            if ( skyMask )
-            {
-                for ( int i = 0; i < screen.gridheight; ++i )
-                    delete[] skyMask[i];
-                delete[] skyMask;
-            }
+            this->screen.gridwidth  = width;
+            this->screen.gridheight = height;
+            allocate();
         }
+        // Set up a Camera without a scene file: the Screen is given by its four corners in world space
+        Camera( const Scene* scene, const Vector& viewpoint, const Vector& topLeft, const Vector& topRight,
+                const Vector& bottomLeft, const Vector& bottomRight, int width, int height )
+            : Camera( scene, viewpoint, Screen(topLeft, topRight, bottomLeft, bottomRight, width, height), width, height )
+        { }
+        ~Camera();
 
         void clear();
-        void paintSky();
-        void gammaCorrect( double gamma );
-
-        void writePixels( std::ostream& os ) const;
+        void resolve( double gamma ); // Turn the linear Framebuffer into the final image
+
+        void writePixels( std::ostream& os, ImageFormat format, int level = -1 ) const; // Write a single level's image if level is set
+        // Dump the linear Framebuffer (with its Sky coverage) so it can be added to another Camera's,
+        // for instance one rendering a different subset of the Zones in another process
+        void writeFramebuffer( std::ostream& os ) const;
+        void addFramebuffer  ( std::istream& is ); // Throws a message if the sizes don't match
+        // Copy the final image into caller memory: width * height * 3 floats of the cropped rectangle (if any), row by row.
+        // With 'linear' set the values are copied as rendered (plus the Sky), without clamping or gamma
+        void readPixels( float* out, bool linear = false ) const;
+
+        // Keep a separate Framebuffer for each of the first 'count' levels of the Zone trees
+        void setLevelCount( int count );
+        int  getLevelCount() const { return levels.size(); }
+
+        // Keep the contribution of each of the first 'count' Lights of the Scene
+        void setLightCount( int count );
+        int  getLightCount() const { return lights.size(); }
+        // Recomposite the image from the Light layers with each Light's emission scaled by a factor.
+        // A Light scaled to black is switched off entirely
+        void relight( const std::vector< Triplet >& scales, double gamma );
+
+        // Keep a map of what each pixel cost to render: the number of Zones that covered it, the number of
+        // Shadow tests run for it and the microseconds spent on it, in the red, green and blue channels
+        void setCostMap( bool on );
+        bool hasCostMap() const { return costMapped; }
+        void writeCostMap( std::ostream& os ) const; // As a PFM image
 
         void move( double delta, Axis chosenAxis );
         void turn( double theta, Axis chosenAxis );
+        // Look at the Scene from the same point and through the same Screen,
+        // optionally with a grid that is 'divisor' times coarser
+        void setPose( const Camera& other, int divisor = 1 );
+        // Only render a rectangle of the grid. The Framebuffers and the image shrink to its size
+        // and Zones that miss it are skipped entirely. A new pose resets it
+        void crop( int x, int y, int width, int height );
+        const BoundingBox getCrop() const; // The part of the grid that's rendered
 
         const Scene*  getScene()      const { return scene; }
         int           getGridwidth () const { return screen.gridwidth; }
         int           getGridheight() const { return screen.gridheight; }
         const Vector& getViewpoint()  const { return viewpoint; }
-        const RGB**   getPixels()     const { return (const RGB**)pixels; }
+        const Vector& getCorner( int i ) const { return screen.window[i]; } // Top left, top right, bottom left, bottom right
+        const float*  getImage()      const { return image; }        // Resolved RGB values between 0 and 1, row by row
+        int           getStride()     const { return frame.stride; } // Pixels per row in the image
 
         const Plane   getPlane()                     const;
         Vector        getScreenX()                   const;
@@ -140,18 +203,30 @@ namespace Silence {
         bool          behind ( const Vector& point ) const;
 
     private:
-        friend int Zone::rasterize( Camera* ) const;
+        Camera( const Camera& );            // Not copyable, the Camera owns its pixels
+        Camera& operator=( const Camera& );
+
+        void allocate(); // (Re)create all Framebuffers to match the Screen
+
+        friend int Zone::rasterize( Camera*, int, int ) const;
 
         friend std::istream& operator>>( std::istream& is, Camera& camera );
 
     private:
         const Scene* const scene;
 
-        Vector   viewpoint;
-        Screen   screen;
-        RGB**    pixels;  // The end results go here
-        double** skyMask; // Empty parts of the screen space
-        bool     rendering;
+        Vector                      viewpoint;
+        Screen                      screen;
+        float*                      arena;  // A single allocation holding all pixels below
+        Framebuffer                 frame;  // The end results go here
+        std::vector< Framebuffer >  levels; // Contributions of each tree level on their own (optional)
+        std::vector< Framebuffer >  lights; // Contributions of each Light on their own (optional)
+        Framebuffer                 costs;  // The cost map (optional), its Sky coverage is unused
+        float*                      image;  // The resolved Framebuffer
+        double                      gamma;  // Gamma of the last resolve
+        int                         cropX, cropY, cropWidth, cropHeight; // The rendered rectangle of the grid, all of it if cropWidth is 0
+        bool                        costMapped;
+        bool                        rendering;
     };
 
 }
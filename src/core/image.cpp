@@ -0,0 +1,313 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Image file writers (and readers) for rendering results
+// Part of Silence, an experimental rendering engine
+
+#include "image.h"
+
+#include <cassert>
+#include <cctype>
+#include <cstring>
+
+namespace Silence {
+
+    // Rows are collected into a buffer of about this size before they're written out
+    static const size_t flushSize = 1 << 16;
+
+    ImageFormat imageFormat( const std::string& filename )
+    {
+        const size_t dot   = filename.rfind( '.' );
+        const size_t slash = filename.rfind( '/' );
+        if ( std::string::npos == dot || (std::string::npos != slash && dot < slash) )
+            return IMAGE_PPM;
+        std::string extension = filename.substr( dot + 1 );
+        for ( std::string::iterator c = extension.begin(); c != extension.end(); c++ )
+            *c = std::tolower( *c );
+        if ( "pfm" == extension )
+            return IMAGE_PFM;
+        if ( "qoi" == extension )
+            return IMAGE_QOI;
+        return IMAGE_PPM;
+    }
+
+    static inline unsigned char toByte( float value )
+    {
+        return (unsigned char)( value * 255 + 0.5f );
+    }
+
+    static void flush( std::ostream& os, std::vector< char >& buffer )
+    {
+        os.write( &buffer[0], buffer.size() );
+        buffer.clear();
+    }
+
+    void writePPM( std::ostream& os, const float* image, int width, int height, int stride )
+    {
+        os << "P6\n" << width << " " << height << "\n" << 255 << "\n";
+        std::vector< char > buffer;
+        buffer.reserve( flushSize + 3 * width );
+        for ( int row = 0; row < height; ++row )
+        {
+            const float* pixel = image + 3 * stride * row;
+            for ( int i = 0; i < 3 * width; ++i )
+                buffer.push_back( toByte(pixel[i]) );
+            if ( flushSize <= buffer.size() )
+                flush( os, buffer );
+        }
+        if ( !buffer.empty() )
+            flush( os, buffer );
+    }
+
+    void writePFM( std::ostream& os, const float* image, int width, int height, int stride )
+    {
+        // The sign of the scale factor tells the byte order
+        const unsigned int one = 1;
+        const bool littleEndian = 1 == *(const unsigned char*)&one;
+        os << "PF\n" << width << " " << height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+        // Rows go from the bottom up and are already in the right layout
+        for ( int row = height - 1; 0 <= row; --row )
+            os.write( (const char*)(image + 3 * stride * row), 3 * width * sizeof(float) );
+    }
+
+    // See the specification at https://qoiformat.org
+    void writeQOI( std::ostream& os, const float* image, int width, int height, int stride )
+    {
+        struct Pixel {
+            unsigned char r, g, b, a;
+            bool operator==( const Pixel& other ) const { return r == other.r && g == other.g && b == other.b && a == other.a; }
+        };
+        std::vector< char > buffer;
+        buffer.reserve( flushSize + 5 * width );
+        const char magic[4] = { 'q', 'o', 'i', 'f' };
+        buffer.insert( buffer.end(), magic, magic + 4 );
+        for ( int shift = 24; 0 <= shift; shift -= 8 )
+            buffer.push_back( (unsigned int)width  >> shift & 0xff );
+        for ( int shift = 24; 0 <= shift; shift -= 8 )
+            buffer.push_back( (unsigned int)height >> shift & 0xff );
+        buffer.push_back( 3 ); // RGB channels
+        buffer.push_back( 0 ); // sRGB with linear alpha
+
+        Pixel index[64] = { };
+        Pixel previous  = { 0, 0, 0, 255 };
+        int   run       = 0;
+        const long last = (long)width * height - 1;
+        for ( int row = 0; row < height; ++row )
+        {
+            const float* values = image + 3 * stride * row;
+            for ( int col = 0; col < width; ++col )
+            {
+                const Pixel pixel = { toByte(values[3*col]), toByte(values[3*col + 1]), toByte(values[3*col + 2]), 255 };
+                if ( pixel == previous )
+                {
+                    ++run;
+                    if ( 62 == run || (long)row * width + col == last )
+                    {
+                        buffer.push_back( (char)(0xc0 | (run - 1)) ); // QOI_OP_RUN
+                        run = 0;
+                    }
+                    continue;
+                }
+                if ( run )
+                {
+                    buffer.push_back( (char)(0xc0 | (run - 1)) ); // QOI_OP_RUN
+                    run = 0;
+                }
+                const int hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+                if ( index[hash] == pixel )
+                    buffer.push_back( (char)hash ); // QOI_OP_INDEX
+                else
+                {
+                    index[hash] = pixel;
+                    const signed char dr = pixel.r - previous.r;
+                    const signed char dg = pixel.g - previous.g;
+                    const signed char db = pixel.b - previous.b;
+                    const int drg = dr - dg;
+                    const int dbg = db - dg;
+                    if ( -2 <= dr && dr <= 1 && -2 <= dg && dg <= 1 && -2 <= db && db <= 1 )
+                        buffer.push_back( (char)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)) ); // QOI_OP_DIFF
+                    else if ( -32 <= dg && dg <= 31 && -8 <= drg && drg <= 7 && -8 <= dbg && dbg <= 7 )
+                    {
+                        buffer.push_back( (char)(0x80 | (dg + 32)) ); // QOI_OP_LUMA
+                        buffer.push_back( (char)((drg + 8) << 4 | (dbg + 8)) );
+                    }
+                    else
+                    {
+                        buffer.push_back( (char)0xfe ); // QOI_OP_RGB
+                        buffer.push_back( pixel.r );
+                        buffer.push_back( pixel.g );
+                        buffer.push_back( pixel.b );
+                    }
+                }
+                previous = pixel;
+            }
+            if ( flushSize <= buffer.size() )
+                flush( os, buffer );
+        }
+        const char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        buffer.insert( buffer.end(), end, end + 8 );
+        flush( os, buffer );
+    }
+
+    void writeImage( std::ostream& os, ImageFormat format, const float* image, int width, int height, int stride )
+    {
+        switch ( format )
+        {
+            case IMAGE_PPM: writePPM( os, image, width, height, stride ); break;
+            case IMAGE_PFM: writePFM( os, image, width, height, stride ); break;
+            case IMAGE_QOI: writeQOI( os, image, width, height, stride ); break;
+            default: assert( false );
+        }
+    }
+
+    static void readPixels( std::istream& is, char* data, size_t size )
+    {
+        if ( !is.read( data, size ) )
+            throw std::string( "image data ends prematurely" );
+    }
+
+    static void readPPM( std::istream& is, std::vector< float >& image, int width, int height )
+    {
+        int maxValue;
+        is >> maxValue;
+        if ( !is || 255 != maxValue )
+            throw std::string( "only 8-bit PPM images are supported" );
+        is.get(); // Single whitespace before the data
+        std::vector< unsigned char > bytes( 3 * width * height );
+        readPixels( is, (char*)&bytes[0], bytes.size() );
+        for ( size_t i = 0; i < bytes.size(); ++i )
+            image[i] = bytes[i] / 255.0f;
+    }
+
+    static void readPFM( std::istream& is, std::vector< float >& image, int width, int height )
+    {
+        double scale;
+        is >> scale;
+        if ( !is || 0 == scale )
+            throw std::string( "malformed PFM header" );
+        is.get();
+        const unsigned int one = 1;
+        const bool littleEndian = 1 == *(const unsigned char*)&one;
+        for ( int row = height - 1; 0 <= row; --row )
+            readPixels( is, (char*)&image[3 * width * row], 3 * width * sizeof(float) );
+        if ( littleEndian != (scale < 0) )
+        {
+            // Written on a machine of the other byte order
+            for ( size_t i = 0; i < image.size(); ++i )
+            {
+                char* bytes = (char*)&image[i];
+                std::swap( bytes[0], bytes[3] );
+                std::swap( bytes[1], bytes[2] );
+            }
+        }
+    }
+
+    static void readQOI( std::istream& is, std::vector< float >& image )
+    {
+        struct Pixel {
+            unsigned char r, g, b, a;
+        };
+        const int channels = is.get();
+        is.get(); // Colorspace
+        if ( 3 != channels && 4 != channels )
+            throw std::string( "malformed QOI header" );
+        Pixel index[64] = { };
+        Pixel pixel     = { 0, 0, 0, 255 };
+        int   run       = 0;
+        for ( size_t i = 0; i < image.size(); i += 3 )
+        {
+            if ( run )
+                --run;
+            else
+            {
+                const int op = is.get();
+                if ( std::char_traits< char >::eof() == op )
+                    throw std::string( "image data ends prematurely" );
+                if ( 0xfe == op )
+                {
+                    pixel.r = is.get();
+                    pixel.g = is.get();
+                    pixel.b = is.get();
+                }
+                else if ( 0xff == op )
+                {
+                    pixel.r = is.get();
+                    pixel.g = is.get();
+                    pixel.b = is.get();
+                    pixel.a = is.get();
+                }
+                else if ( 0x00 == (op & 0xc0) )
+                    pixel = index[op];
+                else if ( 0x40 == (op & 0xc0) )
+                {
+                    pixel.r += (op >> 4 & 3) - 2;
+                    pixel.g += (op >> 2 & 3) - 2;
+                    pixel.b += (op      & 3) - 2;
+                }
+                else if ( 0x80 == (op & 0xc0) )
+                {
+                    const int next = is.get();
+                    const int dg   = (op & 0x3f) - 32;
+                    pixel.r += dg + (next >> 4 & 0xf) - 8;
+                    pixel.g += dg;
+                    pixel.b += dg + (next      & 0xf) - 8;
+                }
+                else
+                    run = op & 0x3f;
+                index[(pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64] = pixel;
+            }
+            image[i]     = pixel.r / 255.0f;
+            image[i + 1] = pixel.g / 255.0f;
+            image[i + 2] = pixel.b / 255.0f;
+        }
+    }
+
+    void readImage( std::istream& is, std::vector< float >& image, int& width, int& height )
+    {
+        char magic[4] = { };
+        readPixels( is, magic, 2 );
+        if ( !strncmp(magic, "P6", 2) || !strncmp(magic, "PF", 2) )
+        {
+            is >> std::ws;
+            while ( '#' == is.peek() )
+                is.ignore( 1 << 16, '\n' ) >> std::ws; // Comment line
+            is >> width >> height;
+            if ( !is || width <= 0 || height <= 0 )
+                throw std::string( "malformed image header" );
+            image.resize( 3 * (size_t)width * height );
+            if ( 'F' == magic[1] )
+                readPFM( is, image, width, height );
+            else
+                readPPM( is, image, width, height );
+            return;
+        }
+        readPixels( is, magic + 2, 2 );
+        if ( strncmp(magic, "qoif", 4) )
+            throw std::string( "unsupported image format" );
+        unsigned char size[8];
+        readPixels( is, (char*)size, 8 );
+        width  = size[0] << 24 | size[1] << 16 | size[2] << 8 | size[3];
+        height = size[4] << 24 | size[5] << 16 | size[6] << 8 | size[7];
+        if ( width <= 0 || height <= 0 )
+            throw std::string( "malformed image header" );
+        image.resize( 3 * (size_t)width * height );
+        readQOI( is, image );
+    }
+
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Image file writers (and readers) for rendering results
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_IMAGE
+#define SILENCE_IMAGE
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Silence {
+
+    enum ImageFormat {
+        IMAGE_PPM, // Binary 8-bit PPM (P6), the default
+        IMAGE_PFM, // Portable float map holding the linear HDR values
+        IMAGE_QOI  // Quite OK Image format, lossless and compact
+    };
+
+    // Choose the format by file extension, falling back on PPM
+    ImageFormat imageFormat( const std::string& filename );
+
+    // All writers take interleaved RGB rows that are 'stride' pixels apart
+    // and send them to the stream one row buffer at a time
+    void writePPM( std::ostream& os, const float* image, int width, int height, int stride ); // Values between 0 and 1
+    void writePFM( std::ostream& os, const float* image, int width, int height, int stride ); // Values unclamped
+    void writeQOI( std::ostream& os, const float* image, int width, int height, int stride ); // Values between 0 and 1
+    void writeImage( std::ostream& os, ImageFormat format, const float* image, int width, int height, int stride );
+
+    // Read back an image in any of the formats above, with rows 'width' pixels apart.
+    // Throws a message if the stream holds anything else
+    void readImage( std::istream& is, std::vector< float >& image, int& width, int& height );
+
+}
+
+#endif // SILENCE_IMAGE
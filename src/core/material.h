@@ -83,6 +83,8 @@ namespace Silence {
             assert( 1 <= refractiveIndex );
         }
 
+        void setRefractiveIndex( double value ) { refractiveIndex = value; }
+
         const RGB& getColor()           const { return color; }
         double     getRefractiveIndex() const { return refractiveIndex; }
 
@@ -98,9 +100,6 @@ namespace Silence {
             }
         }
 
-        friend std::istream& operator>>( std::istream& is, Character& character );
-        friend std::istream& operator>>( std::istream& is, Material& material );
-
     private:
         Character character;
         RGB       color;
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// PerThread class template: a value each thread updates on its own that can still be read as a whole
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_PERTHREAD
+#define SILENCE_PERTHREAD
+
+#include <mutex>
+#include <vector>
+
+namespace Silence {
+
+    // Each thread gets a T of its own to write to without locking. The Ts of running threads are listed
+    // so they can be gathered up, and a thread that ends merges its T into a retired one that is kept.
+    // T needs a default constructor and a merge( const T& other ) method
+    template< class T >
+    class PerThread {
+    public:
+        // The calling thread's own T, made the first time it asks
+        static T& local()
+        {
+            static thread_local Slot slot;
+            return slot.value;
+        }
+
+        // Call the visitor on the retired T and then on the T of each running thread, under the lock.
+        // Not while other threads are writing to theirs
+        template< class Visitor >
+        static void visit( Visitor visitor )
+        {
+            Registry& registry = getRegistry();
+            std::lock_guard< std::mutex > guard( registry.lock );
+            visitor( registry.retired );
+            for ( typename std::vector< T* >::const_iterator value = registry.values.begin(); value != registry.values.end(); value++ )
+                visitor( **value );
+        }
+
+    private:
+        struct Registry {
+            std::mutex         lock;
+            std::vector< T* >  values;
+            T                  retired;
+        };
+
+        struct Slot {
+            Slot()
+            {
+                Registry& registry = getRegistry();
+                std::lock_guard< std::mutex > guard( registry.lock );
+                registry.values.push_back( &value );
+            }
+            ~Slot()
+            {
+                Registry& registry = getRegistry();
+                std::lock_guard< std::mutex > guard( registry.lock );
+                registry.retired.merge( value );
+                for ( typename std::vector< T* >::iterator v = registry.values.begin(); v != registry.values.end(); v++ )
+                    if ( *v == &value )
+                    {
+                        registry.values.erase( v );
+                        break;
+                    }
+            }
+
+            T value;
+        };
+
+        // Made on first use so it outlives every Slot, the main thread's included
+        static Registry& getRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+    };
+
+}
+
+#endif // SILENCE_PERTHREAD
+
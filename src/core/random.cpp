@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Random class methods
+// Part of Silence, an experimental rendering engine
+
+#include "random.h"
+
+#include <atomic>
+
+namespace Silence {
+
+    static std::atomic< uint64_t > globalSeed( 0 );
+
+    static uint64_t splitmix( uint64_t& x )
+    {
+        uint64_t z = ( x += 0x9e3779b97f4a7c15ULL );
+        z = ( z ^ (z >> 30) ) * 0xbf58476d1ce4e5b9ULL;
+        z = ( z ^ (z >> 27) ) * 0x94d049bb133111ebULL;
+        return z ^ ( z >> 31 );
+    }
+
+    static uint64_t rotate( uint64_t x, int k )
+    {
+        return ( x << k ) | ( x >> (64 - k) );
+    }
+
+    Random::Random( uint64_t stream )
+    {
+        reseed( globalSeed, stream );
+    }
+
+    Random::Random( uint64_t seed, uint64_t stream )
+    {
+        reseed( seed, stream );
+    }
+
+    void Random::reseed( uint64_t seed, uint64_t stream )
+    {
+        // Hash the seed and the stream separately so that neighbouring streams don't start out
+        // a few steps apart on the same splitmix sequence
+        uint64_t x = seed;
+        uint64_t y = stream ^ 0x6a09e667f3bcc909ULL;
+        const uint64_t mixed = splitmix( x ) ^ splitmix( y );
+        x = mixed;
+        for ( int i = 0; i < 4; ++i )
+            state[i] = splitmix( x );
+    }
+
+    uint64_t Random::next()
+    {
+        const uint64_t result = rotate( state[1] * 5, 7 ) * 9;
+        const uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3]  = rotate( state[3], 45 );
+        return result;
+    }
+
+    double Random::uniform()
+    {
+        // The top 53 bits fill the mantissa exactly
+        return ( next() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+    }
+
+    void Random::setSeed( uint64_t seed )
+    {
+        globalSeed = seed;
+    }
+
+    uint64_t Random::getSeed()
+    {
+        return globalSeed;
+    }
+
+}
+
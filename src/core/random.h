@@ -0,0 +1,57 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Random class for fast pseudo-random numbers that are reproducible and safe to use from any thread
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_RANDOM
+#define SILENCE_RANDOM
+
+#include <stdint.h>
+
+namespace Silence {
+
+    // xoshiro256** seeded through splitmix64, see prng.di.unimi.it
+    // Every generator belongs to a numbered stream, and different streams under the same seed give
+    // independent sequences. Whatever needs to be reproducible should own a generator with a stream
+    // of its own rather than share one
+    class Random {
+    public:
+        explicit Random( uint64_t stream = 0 ); // Uses the global seed
+        Random( uint64_t seed, uint64_t stream );
+
+        uint64_t next();
+        double   uniform();                           // Between 0 (inclusive) and 1 (exclusive)
+        double   uniform( double low, double high ) { return low + (high - low) * uniform(); }
+
+        // Generators created after this call start from the new seed
+        static void     setSeed( uint64_t seed );
+        static uint64_t getSeed();
+
+    private:
+        void reseed( uint64_t seed, uint64_t stream );
+
+    private:
+        uint64_t state[4];
+    };
+
+}
+
+#endif // SILENCE_RANDOM
+
@@ -60,6 +60,17 @@ namespace Silence {
 
         double findNearestIntersection();
 
+    private:
+        // For RayPackets: the direction is known to be normalized already
+        Ray( const Scene* scene, const Vector& origin, const Vector& direction, const Thing* medium, bool )
+            : scene( scene )
+            , origin( origin )
+            , direction( direction )
+            , medium( medium )
+        { }
+
+        friend struct RayPacket;
+
     private:
         const Scene* const scene;
 
@@ -68,6 +79,33 @@ namespace Silence {
         const Thing* medium; // The Thing the Ray is born inside
     };
 
+    // Up to PACKETSIZE Rays in the same medium, stored component by component so that
+    // the Surfaces can intersect all of them in a single vectorized loop
+    struct RayPacket {
+        RayPacket( const Scene* scene, const Thing* medium = NULL )
+            : scene( scene )
+            , medium( medium )
+            , count( 0 )
+        { }
+
+        void push_back( const Ray& ray )
+        {
+            assert( count < PACKETSIZE );
+            ox[count] = ray.getOrigin().x;    oy[count] = ray.getOrigin().y;    oz[count] = ray.getOrigin().z;
+            dx[count] = ray.getDirection().x; dy[count] = ray.getDirection().y; dz[count] = ray.getDirection().z;
+            ++count;
+        }
+
+        Vector getOrigin( int i ) const { return Vector( ox[i], oy[i], oz[i] ); }
+        Ray    operator[]( int i ) const { return Ray( scene, getOrigin(i), Vector(dx[i], dy[i], dz[i]), medium, true ); }
+
+        const Scene* scene;
+        const Thing* medium;
+        int          count;
+        double       ox[PACKETSIZE], oy[PACKETSIZE], oz[PACKETSIZE]; // Origins
+        double       dx[PACKETSIZE], dy[PACKETSIZE], dz[PACKETSIZE]; // Normalized directions
+    };
+
 }
 
 #endif // SILENCE_RAY
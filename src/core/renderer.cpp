@@ -22,14 +22,20 @@
 
 #include "renderer.h"
 
+#include <algorithm>
 #include <chrono>
+#include <sstream>
 
 #include "camera.h"
 #include "scene.h"
+#include "stats.h"
+#include "trace.h"
 #include "zone.h"
 
 namespace Silence {
 
+    typedef std::chrono::steady_clock Clock;
+
     void Renderer::addCamera( Camera* camera )
     {
         assert( camera && camera->getScene() );
@@ -42,15 +48,80 @@ namespace Silence {
         cameras.erase( cameras.begin() + i );
     }
 
-    void Renderer::render( int /*time*/, int depth, int level, double cutoff, double gamma )
+    Camera* Renderer::findCamera( const Camera* camera ) const
+    {
+        for ( std::vector< Camera* >::const_iterator c = cameras.begin(); c != cameras.end(); c++ )
+            if ( *c == camera )
+                return *c;
+        return NULL;
+    }
+
+    void Renderer::setShard( int index, int count )
+    {
+        assert( !rendering && 0 <= index && index < count );
+        if ( index == shardIndex && count == shardCount )
+            return;
+        shardIndex = index;
+        shardCount = count;
+        clearZoneForest();
+    }
+
+    bool Renderer::render( int time, int depth, int level, double cutoff, double gamma )
+    {
+        return build( time, depth, level, cutoff ) && rasterize( time, level, gamma );
+    }
+
+    // Phase One on its own: starts a new frame
+    bool Renderer::build( int /*time*/, int depth, int level, double cutoff )
     {
         assert( !rendering );
         rendering = true;
+        cancelled = false;
+        // Zones are independent of the Cameras but not of the Objects in the Scene
+        if ( scene->isChanged() )
+        {
+            clearZoneForest();
+            scene->clearChanged();
+        }
         /* TODO: time control... */
+        const Clock::time_point start = Clock::now();
         buildZoneForest( 0, depth, level, cutoff );
-        rasterizeByZone(0, level, gamma);
-        /*...*/
+        buildTime = std::chrono::duration< double >( Clock::now() - start ).count();
+        rendering = false;
+        return !cancelled;
+    }
+
+    // Phase Two on its own: finishes the frame started by build
+    bool Renderer::rasterize( int /*time*/, int level, double gamma )
+    {
+        assert( !rendering && zoneForestReady );
+        rendering = true;
+        /* TODO: time control... */
+        const Clock::time_point start = Clock::now();
+        rasterizeByZone( 0, level, gamma );
+        rasterizeTime = std::chrono::duration< double >( Clock::now() - start ).count();
         rendering = false;
+        return !cancelled;
+    }
+
+    bool Renderer::renderCamera( Camera* camera, int time, int depth, int level, double cutoff, double gamma )
+    {
+        assert( findCamera(camera) );
+        if ( !build(time, depth, level, cutoff) )
+            return false;
+        rendering = true;
+        const Clock::time_point start = Clock::now();
+        rasterizeCamera( camera, level, gamma );
+        rasterizeTime = std::chrono::duration< double >( Clock::now() - start ).count();
+        rendering = false;
+        return !cancelled;
+    }
+
+    bool Renderer::rasterize( Camera* camera, int level, double gamma )
+    {
+        assert( camera && zoneForestReady );
+        rasterizeCamera( camera, level, gamma );
+        return !cancelled;
     }
 
     void Renderer::buildZoneForest( int /*time*/, int depth, int level, double cutoff )
@@ -60,37 +131,90 @@ namespace Silence {
         if ( modeFlags.verbose )
             std::cerr << "Renderer: tracing Zones from lightsources... " << std::flush;
         zoneForest.clear();
+        forestLights.clear();
         /* TODO: time control... */
-        for ( LightIt light = scene->lightsBegin(); light != scene->lightsEnd(); light++ )
-            (*light)->emitZones( zoneForest );
+        {
+            Stats::Timer timer( "emitZones" );
+            Trace::Scope trace( "emit zones" );
+            for ( LightIt light = scene->lightsBegin(); light != scene->lightsEnd(); light++ )
+            {
+                (*light)->emitZones( zoneForest );
+                forestLights.resize( zoneForest.size(), light - scene->lightsBegin() );
+            }
+        }
+        if ( 1 < shardCount )
+        {
+            // Drop the roots of the other shards before they grow any branches
+            unsigned int kept = 0;
+            for ( unsigned int i = 0; i < zoneForest.size(); ++i )
+            {
+                if ( (int)i % shardCount == shardIndex )
+                {
+                    zoneForest[kept]   = zoneForest[i];
+                    forestLights[kept] = forestLights[i];
+                    ++kept;
+                }
+                else
+                    delete zoneForest[i];
+            }
+            zoneForest  .resize( kept );
+            forestLights.resize( kept );
+        }
+        Stats::count( Stats::ZONES_CREATED, zoneForest.size() );
+        std::vector< double > levelTimes; // Each level summed up over all Trees
         for ( ForestIt tree = zoneForest.begin(); tree != zoneForest.end(); tree++ )
         {
+            Trace::Scope treeTrace( "expand tree", "tree", tree - zoneForest.begin() );
             (*tree)->getValue()->setNode( *tree ); // Wrap up the Zone's initialization
             for ( int d = 1; d < depth && (-1 == level || d - 1 < level); ++d )
             {
+                Trace::Scope levelTrace( "bounce level", "level", d );
+                const Clock::time_point levelStart = Clock::now();
                 std::vector< Tree<Zone>* > leaves = (*tree)->getLeaves();
                 for ( std::vector< Tree<Zone>* >::iterator leaf = leaves.begin(); leaf != leaves.end(); leaf++ )
                 {
+                    if ( cancelled )
+                    {
+                        // A half-built forest is no use to anyone
+                        clearZoneForest();
+                        if ( modeFlags.verbose )
+                            std::cerr << "cancelled." << std::endl;
+                        return;
+                    }
                     const Triplet& color = (*leaf)->getValue()->getLight().getColor();
                     if ( color.x + color.y + color.z <= max(0, cutoff) )
+                    {
+                        Stats::count( Stats::ZONES_PRUNED );
                         continue;
+                    }
                     std::vector< Zone* > children = (*leaf)->getValue()->bounce();
+                    Stats::count( Stats::ZONES_CREATED, children.size() );
                     for ( std::vector< Zone* >::iterator child = children.begin(); child != children.end(); child++ )
                     {
                         Tree< Zone >* node = (*leaf)->addChild(*child);
                         (*child)->setNode( node );
                     }
                 }
+                if ( (int)levelTimes.size() < d )
+                    levelTimes.resize( d, 0 );
+                levelTimes[d - 1] += std::chrono::duration< double >( Clock::now() - levelStart ).count();
             }
         }
+        if ( Stats::isEnabled() )
+            for ( unsigned int d = 0; d < levelTimes.size(); ++d )
+            {
+                std::ostringstream phase;
+                phase << "build level " << d + 1;
+                Stats::time( phase.str(), levelTimes[d] );
+            }
 
+        zoneCount = 0;
+        for ( ForestIt tree = zoneForest.begin(); tree != zoneForest.end(); tree++ )
+            zoneCount += (*tree)->count();
         if ( modeFlags.verbose )
         {
             std::cerr << "done." << std::endl;
-            int totalCount = 0;
-            for ( ForestIt tree = zoneForest.begin(); tree != zoneForest.end(); tree++ )
-                totalCount += (*tree)->count();
-            std::cerr << "Renderer: created " << totalCount << " Zones total in " << zoneForest.size() << " Trees." << std::endl;
+            std::cerr << "Renderer: created " << zoneCount << " Zones total in " << zoneForest.size() << " Trees." << std::endl;
         }
         zoneForestReady = true;
     }
@@ -98,9 +222,11 @@ namespace Silence {
     void Renderer::clearZoneForest()
     {
         zoneForestReady = false;
+        zoneCount       = 0;
         for ( ForestIt tree = zoneForest.begin(); tree != zoneForest.end(); tree++ )
             delete *tree;
         zoneForest.clear();
+        forestLights.clear();
     }
 
     // Rasterize all Zones in zoneForest to each Camera
@@ -122,26 +248,13 @@ namespace Silence {
         /* TODO: time control... */
         for ( CameraIt camera = cameras.begin(); camera != cameras.end(); camera++ )
         {
-            (*camera)->clear();
-            for ( ForestIt tree = zoneForest.begin(); tree != zoneForest.end(); tree++ )
+            rasterizeCamera( *camera, level, gamma );
+            if ( cancelled )
             {
-                std::vector< Tree<Zone>* > children;
-                children.push_back( *tree );
-                for ( int thisLevel = 0; (-1 == level || thisLevel <= level) && !children.empty(); ++thisLevel )
-                {
-                    std::vector< Tree<Zone>* > grandchildren;
-                    for ( Tree<Zone>::TreeIt child = children.begin(); child != children.end(); child++ )
-                    {
-                        if ( -1 == level || thisLevel == level )
-                            pathsTotal += (*child)->getValue()->rasterize( *camera );
-                        for ( Tree<Zone>::TreeIt grandchild = (*child)->childrenBegin(); grandchild != (*child)->childrenEnd(); grandchild++ )
-                            grandchildren.push_back( *grandchild );
-                    }
-                    children = grandchildren;
-                }
+                if ( modeFlags.verbose )
+                    std::cerr << "cancelled." << std::endl;
+                return;
             }
-            (*camera)->paintSky();
-            (*camera)->gammaCorrect( gamma );
         }
         if ( modeFlags.verbose )
         {
@@ -150,4 +263,45 @@ namespace Silence {
         }
     }
 
+    // Rasterize all Zones in zoneForest to one Camera, level by level
+    void Renderer::rasterizeCamera( Camera* camera, int level, double gamma )
+    {
+        const Clock::time_point start = Clock::now();
+        camera->clear();
+        for ( ForestIt tree = zoneForest.begin(); tree != zoneForest.end(); tree++ )
+        {
+            Trace::Scope trace( "rasterize tree", "tree", tree - zoneForest.begin() );
+            std::vector< Tree<Zone>* > children;
+            children.push_back( *tree );
+            for ( int thisLevel = 0; (-1 == level || thisLevel <= level) && !children.empty(); ++thisLevel )
+            {
+                std::vector< Tree<Zone>* > grandchildren;
+                for ( Tree<Zone>::TreeIt child = children.begin(); child != children.end(); child++ )
+                {
+                    if ( cancelled )
+                        return;
+                    if ( -1 == level || thisLevel == level )
+                        pathsTotal += (*child)->getValue()->rasterize( camera, thisLevel, forestLights[tree - zoneForest.begin()] );
+                    for ( Tree<Zone>::TreeIt grandchild = (*child)->childrenBegin(); grandchild != (*child)->childrenEnd(); grandchild++ )
+                        grandchildren.push_back( *grandchild );
+                }
+                children = grandchildren;
+            }
+        }
+        if ( Stats::isEnabled() )
+        {
+            // Cameras rendered without being added, like the server's, have no index to go by
+            const std::vector< Camera* >::const_iterator added = std::find( cameras.begin(), cameras.end(), camera );
+            std::ostringstream phase;
+            if ( added == cameras.end() )
+                phase << "rasterize other camera";
+            else
+                phase << "rasterize camera " << added - cameras.begin();
+            Stats::time( phase.str(), std::chrono::duration< double >( Clock::now() - start ).count() );
+        }
+        Stats::Timer timer( "sky and gamma" );
+        Trace::Scope trace( "resolve" );
+        camera->resolve( gamma );
+    }
+
 }
@@ -44,35 +44,75 @@ namespace Silence {
             : scene( scene )
             , cameras()
             , zoneForest()
+            , forestLights()
+            , shardIndex( 0 )
+            , shardCount( 1 )
             , zoneForestReady( false )
             , rendering( false )
+            , cancelled( false )
             , pathsTotal( 0 )
+            , zoneCount( 0 )
+            , buildTime( 0 )
+            , rasterizeTime( 0 )
         { }
+        ~Renderer() { clearZoneForest(); }
+
+        void    addCamera( Camera* camera );
+        void    removeCamera( unsigned int i );
+        Camera* findCamera( const Camera* camera ) const; // The same Camera if it was added, NULL otherwise
+
+        // Only follow every 'count'th tree of Zones emitted by the Lights, starting from 'index'.
+        // The trees add up independently, so the Framebuffers of all shards sum to the full frame
+        void setShard( int index, int count );
+
+        // Returns false if the frame was cancelled before it was finished
+        bool render( int time, int depth, int level = -1, double cutoff = 0, double gamma = 1 );
+        // The two phases of render() one by one, so they can be overlapped across Renderers
+        bool build    ( int time, int depth, int level = -1, double cutoff = 0 );
+        bool rasterize( int time, int level = -1, double gamma = 1 );
+        // Render a frame to only one of the added Cameras
+        bool renderCamera( Camera* camera, int time, int depth, int level = -1, double cutoff = 0, double gamma = 1 );
+        // Rasterize the finished Zone forest to a single Camera that need not be added to this Renderer.
+        // The forest is left untouched, so several threads may do this at once with different Cameras
+        bool rasterize( Camera* camera, int level = -1, double gamma = 1 );
+        // Abandon the frame in progress as soon as possible. Safe to call from any thread
+        void cancel() { cancelled = true; }
+        // Drop the Zones so the next frame builds them from scratch even if the Scene hasn't changed
+        void clearZoneForest();
 
-        void addCamera( Camera* camera );
-        void removeCamera( unsigned int i );
-
-        void render( int time, int depth, int level = -1, double cutoff = 0, double gamma = 1 );
+        // How long the phases of the last frame took in seconds
+        double getBuildTime()     const { return buildTime; }
+        double getRasterizeTime() const { return rasterizeTime; }
+        // How many Zones the current forest has and how many pixels have been shaded since the Renderer was created
+        int    getZoneCount()     const { return zoneCount; }
+        long   getPathCount()     const { return pathsTotal; }
 
     private:
         // Phase One
         void buildZoneForest( int time, int depth, int level = -1, double cutoff = 0 );
-        void clearZoneForest();
 
         // Phase Two
         void rasterizeByPixel( int time, int level, double gamma );
         void rasterizeByZone ( int time, int level, double gamma );
+        void rasterizeCamera ( Camera* camera, int level, double gamma );
 
     private:
         const Scene* const scene;
 
         std::vector< Camera* >     cameras;
         std::vector< Tree<Zone>* > zoneForest;
+        std::vector< int >         forestLights; // Which Light each tree in zoneForest was emitted by
+        int                        shardIndex;
+        int                        shardCount;
 
         // State and housekeeping
         bool zoneForestReady;
         bool rendering;
-        std::atomic< int > pathsTotal;
+        std::atomic< bool > cancelled;
+        std::atomic< long > pathsTotal;
+        int zoneCount;
+        double buildTime;
+        double rasterizeTime;
     };
 
 }
@@ -25,6 +25,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <cassert>
+#include <string>
 
 #include "beam.h"
 #include "ray.h"
@@ -61,6 +62,13 @@ namespace Silence {
         point = newPoint;
     }
 
+    // Fallback for Surfaces without a kernel of their own: one Ray at a time
+    void Surface::intersectPacket( const RayPacket& rays, double* t ) const
+    {
+        for ( int i = 0; i < rays.count; ++i )
+            t[i] = intersect( rays[i] );
+    }
+
     void Light::emitZones( std::vector< Tree<Zone>* >& out ) const
     {
         if ( RGB::Black == emission )
@@ -81,16 +89,56 @@ namespace Silence {
         scene->setChanged();
     }
 
+    Thing::~Thing()
+    {
+        for ( ThingPartIt part = partsBegin(); part != partsEnd(); part++ )
+            if ( !dynamic_cast<const MeshTriangle*>(*part) )
+                delete *part;
+        for ( MeshIt mesh = meshesBegin(); mesh != meshesEnd(); mesh++ )
+            delete *mesh;
+    }
+    void Thing::push_back( Mesh* mesh )
+    {
+        assert( this == mesh->getParent() );
+        meshes.push_back( mesh );
+        for ( unsigned int face = 0; face < mesh->getFaceCount(); ++face )
+            parts.push_back( mesh->getFace(face) );
+    }
+    Thing* Thing::instantiate() const
+    {
+        Thing* copy = new Thing( scene );
+        copy->background = background;
+        copy->backCulled = backCulled;
+        copy->material   = material;
+        for ( ThingPartIt part = partsBegin(); part != partsEnd(); part++ )
+        {
+            if ( const MeshTriangle* face = dynamic_cast<const MeshTriangle*>(*part) )
+            {
+                if ( 0 == face->getFace() ) // The whole Mesh is copied in place of its first face
+                {
+                    std::vector< Vector > vertices( face->getMesh()->getVertices() );
+                    copy->push_back( new Mesh( copy, vertices, *face->getMesh() ) );
+                }
+            }
+            else
+                copy->push_back( (*part)->clone( copy ) );
+        }
+        return copy;
+    }
     void Thing::move( const Vector& translation ) const
     {
         for ( ThingPartIt part = partsBegin(); part != partsEnd(); part++ )
             (*part)->move( translation );
+        for ( MeshIt mesh = meshesBegin(); mesh != meshesEnd(); mesh++ )
+            (*mesh)->move( translation );
         scene->setChanged();
     }
     void Thing::move( double theta, WorldAxis axis ) const
     {
         for ( ThingPartIt part = partsBegin(); part != partsEnd(); part++ )
             (*part)->move( theta, axis );
+        for ( MeshIt mesh = meshesBegin(); mesh != meshesEnd(); mesh++ )
+            (*mesh)->move( theta, axis );
         scene->setChanged();
     }
 
@@ -112,6 +160,26 @@ namespace Silence {
         return 0;
     }
 
+    // The kernels below must give exactly the same results as their single Ray counterparts,
+    // so they repeat the same arithmetic in the same order, only without branches
+    void ISphere::intersectPacket( const RayPacket& rays, double* t ) const
+    {
+        const bool backCulled = parent->isBackCulled();
+        #pragma omp simd
+        for ( int i = 0; i < rays.count; ++i )
+        {
+            const double toCenterX = center.x - rays.ox[i];
+            const double toCenterY = center.y - rays.oy[i];
+            const double toCenterZ = center.z - rays.oz[i];
+            const double b = toCenterX * rays.dx[i] + toCenterY * rays.dy[i] + toCenterZ * rays.dz[i];
+            const double discriminant = b * b - (toCenterX * toCenterX + toCenterY * toCenterY + toCenterZ * toCenterZ) + radius * radius;
+            const double sqrtDiscriminant = sqrt( discriminant < 0 ? 0 : discriminant );
+            const double nearT = b - sqrtDiscriminant;
+            const double farT  = b + sqrtDiscriminant;
+            t[i] = discriminant < 0 ? 0 : nearT > EPSILON ? nearT : farT > EPSILON && !backCulled ? farT : 0;
+        }
+    }
+
     double IPlane::intersect( const Ray& ray ) const
     {
         // Common ray/plane intersection algorithm, see Ogre for example
@@ -131,7 +199,22 @@ namespace Silence {
         }
     }
 
-    double ITriangle::intersect( const Ray& ray ) const
+    void IPlane::intersectPacket( const RayPacket& rays, double* t ) const
+    {
+        const bool backCulled = NULL == parent || parent->isBackCulled();
+        #pragma omp simd
+        for ( int i = 0; i < rays.count; ++i )
+        {
+            const double denominator = normal.x * rays.dx[i] + normal.y * rays.dy[i] + normal.z * rays.dz[i];
+            const double nominator   = offset - (normal.x * rays.ox[i] + normal.y * rays.oy[i] + normal.z * rays.oz[i]);
+            const double planeT      = nominator / denominator;
+            const bool   miss        = abs( denominator ) < EPSILON || (backCulled && EPSILON < nominator) || !(EPSILON < planeT);
+            t[i] = miss ? 0 : planeT;
+        }
+    }
+
+    // The parts of Triangles and MeshTriangles that only depend on their corners
+    static double intersectTriangle( const Vector* points, bool backCulled, const Ray& ray )
     {
         // Möller-Trumbore algorithm
         // en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
@@ -140,7 +223,7 @@ namespace Silence {
         const Vector edge2 = points[2] - points[0];
         const Vector P = ray.getDirection().cross( edge2 );
         const double determinant = edge1 * P;
-        if ( parent->isBackCulled() )
+        if ( backCulled )
         {
             if ( determinant < EPSILON )
                 return 0;
@@ -165,6 +248,46 @@ namespace Silence {
             return t;
     }
 
+    static void intersectTrianglePacket( const Vector* points, bool backCulled, const RayPacket& rays, double* t )
+    {
+        // Möller-Trumbore again, see above
+        const Vector edge1 = points[1] - points[0];
+        const Vector edge2 = points[2] - points[0];
+        #pragma omp simd
+        for ( int i = 0; i < rays.count; ++i )
+        {
+            // P = direction x edge2
+            const double Px = rays.dy[i] * edge2.z - edge2.y * rays.dz[i];
+            const double Py = rays.dz[i] * edge2.x - edge2.z * rays.dx[i];
+            const double Pz = rays.dx[i] * edge2.y - edge2.x * rays.dy[i];
+            const double determinant = edge1.x * Px + edge1.y * Py + edge1.z * Pz;
+            const bool   parallel = backCulled ? determinant < EPSILON : abs( determinant ) < EPSILON;
+            // T = origin - points[0]
+            const double Tx = rays.ox[i] - points[0].x;
+            const double Ty = rays.oy[i] - points[0].y;
+            const double Tz = rays.oz[i] - points[0].z;
+            const double u = (Tx * Px + Ty * Py + Tz * Pz) / determinant;
+            // Q = T x edge1
+            const double Qx = Ty * edge1.z - edge1.y * Tz;
+            const double Qy = Tz * edge1.x - edge1.z * Tx;
+            const double Qz = Tx * edge1.y - edge1.x * Ty;
+            const double v = (rays.dx[i] * Qx + rays.dy[i] * Qy + rays.dz[i] * Qz) / determinant;
+            const double triangleT = (edge2.x * Qx + edge2.y * Qy + edge2.z * Qz) / determinant;
+            const bool   miss = parallel || u < 0 || 1 < u || v < 0 || 1 < u + v || triangleT < EPSILON;
+            t[i] = miss ? 0 : triangleT;
+        }
+    }
+
+    double ITriangle::intersect( const Ray& ray ) const
+    {
+        return intersectTriangle( points, parent->isBackCulled(), ray );
+    }
+
+    void ITriangle::intersectPacket( const RayPacket& rays, double* t ) const
+    {
+        intersectTrianglePacket( points, parent->isBackCulled(), rays, t );
+    }
+
     const BoundingBox IPoint::getBoundingBox( const Camera* camera ) const
     {
         ScreenPoint screenpoint = camera->project( point );
@@ -194,9 +317,9 @@ namespace Silence {
             return (sphere->center - center).length() + sphere->radius < radius + EPSILON;
         else if (                             dynamic_cast<const IPlane*   >(source) )
             return false;
-        else if ( const ITriangle* triangle = dynamic_cast<const ITriangle*>(source) )
+        else if ( dynamic_cast<const ITriangle*>(source) || dynamic_cast<const MeshTriangle*>(source) )
         {
-            const std::vector< Vector > points = triangle->getPoints( Vector::Zero );
+            const std::vector< Vector > points = source->getPoints( Vector::Zero );
             for ( int i = 0; i < 3; ++i )
                 if ( radius + EPSILON < (points[i] - center).length() )
                     return false;
@@ -241,6 +364,11 @@ namespace Silence {
         return 1;
     }
 
+    ThingPart* Sphere::clone( const Thing* parent ) const
+    {
+        return new Sphere( parent, center, radius );
+    }
+
     Vector Sphere::mirror( const Vector& point ) const
     {
         // TODO: Right this wrong.
@@ -325,9 +453,9 @@ namespace Silence {
             else
                 return false;
         }
-        else if ( const ITriangle* triangle = dynamic_cast<const ITriangle*>(source) )
+        else if ( dynamic_cast<const ITriangle*>(source) || dynamic_cast<const MeshTriangle*>(source) )
         {
-            const std::vector< Vector > points = triangle->getPoints( Vector::Zero );
+            const std::vector< Vector > points = source->getPoints( Vector::Zero );
             for ( int i = 0; i < 3; ++i )
                 if ( offset + EPSILON < normal * points[i] )
                     return false;
@@ -367,6 +495,11 @@ namespace Silence {
             return abs( normal * (point - parentBeam.getApex()).normalized() );
     }
 
+    ThingPart* Plane::clone( const Thing* parent ) const
+    {
+        return new Plane( parent, normal, offset );
+    }
+
     Vector Plane::mirror( const Vector& point ) const
     {
         const double distance = point * normal - offset;
@@ -439,10 +572,8 @@ namespace Silence {
         }
     }
 
-    bool ITriangle::behind( const Surface* source ) const
+    static bool behindTriangle( const Vector& normal, double offset, const Surface* source )
     {
-        const Vector normal = ( points[1] - points[0] ).cross( points[2] - points[0] ).normalize();
-        const double offset = normal * points[0];
         // C++ lacks multi-dispatch. We make do with dynamic_cast instead
         if      ( const IPoint*    point    = dynamic_cast<const IPoint*   >(source) )
             return normal * point->getPoint() < offset + EPSILON;
@@ -457,9 +588,9 @@ namespace Silence {
             else
                 return false;
         }
-        else if ( const ITriangle* triangle = dynamic_cast<const ITriangle*>(source) )
+        else if ( dynamic_cast<const ITriangle*>(source) || dynamic_cast<const MeshTriangle*>(source) )
         {
-            const std::vector< Vector > points = triangle->getPoints( Vector::Zero );
+            const std::vector< Vector > points = source->getPoints( Vector::Zero );
             for ( int i = 0; i < 3; ++i )
                 if ( offset + EPSILON < normal * points[i] )
                     return false;
@@ -469,7 +600,7 @@ namespace Silence {
             assert( false );
     }
 
-    const BoundingBox ITriangle::getBoundingBox( const Camera* camera ) const
+    static const BoundingBox triangleBoundingBox( const Vector* points, const Camera* camera )
     {
         const ScreenPoint screenpoint0 = camera->project( points[0] );
         const ScreenPoint screenpoint1 = camera->project( points[1] );
@@ -481,41 +612,18 @@ namespace Silence {
         return BoundingBox( ScreenPoint(minCol, minRow), ScreenPoint(maxCol, maxRow) );
     }
 
-    std::vector< Vector > ITriangle::getPoints( const Vector& ) const
-    {
-        std::vector< Vector > pointsVector;
-        pointsVector.push_back( points[0] );
-        pointsVector.push_back( points[1] );
-        pointsVector.push_back( points[2] );
-        return pointsVector;
-    }
-
-    double Triangle::getTilt( const Vector& point, const Beam& parentBeam ) const
-    {
-        const Vector normal = ( points[1] - points[0] ).cross( points[2] - points[0] ).normalize();
-        if ( const IPlane* plane = dynamic_cast<const IPlane*>(parentBeam.getSource()) )
-        {
-            std::cout << "tilt = " << 0.5 + 0.5 * (normal * plane->getNormal()) << std::endl;
-            return 0.5 + 0.5 * (normal * plane->getNormal());
-        }
-        else
-            return abs( normal * (point - parentBeam.getApex()).normalized() );
-    }
-
-    Vector Triangle::mirror( const Vector& point ) const
+    static Vector mirrorTriangle( const Vector& normal, double offset, const Vector& point )
     {
-        const Vector normal = ( points[1] - points[0] ).cross( points[2] - points[0] ).normalize();
-        const double offset = normal * points[0];
         const double distance = point * normal - offset;
         return point - normal * 2 * distance;
     }
 
-    Beam Triangle::bounce( const Beam& beam, const Material::Interaction& interaction ) const
+    static Beam bounceTriangle( const ThingPart* part, const Vector* points, const Beam& beam, const Material::Interaction& interaction )
     {
         const Ray adjustedPivot( beam.getScene(), beam.getPivot().getOrigin(),
-                                -getNormal(Vector::Invalid) + beam.getPivot().getDirection()*TANPIOVER6 );
-        const Vector hitPoint = adjustedPivot[ intersect(adjustedPivot) ];
-        const Thing* thing = static_cast<const Thing*>( parent );
+                                -part->getNormal(Vector::Invalid) + beam.getPivot().getDirection()*TANPIOVER6 );
+        const Vector hitPoint = adjustedPivot[ part->intersect(adjustedPivot) ];
+        const Thing* thing = static_cast<const Thing*>( part->getParent() );
 
         Vector             newApex  = Vector::Invalid;
         const Thing*       newMedium = beam.getMedium();
@@ -527,46 +635,213 @@ namespace Silence {
         {
             case Material::DIFFUSE:
                 newApex  = (points[0] + points[1] + points[2]) * 0.333;
-                newPivot = new Ray( beam.getScene(), hitPoint, getNormal(hitPoint) );
+                newPivot = new Ray( beam.getScene(), hitPoint, part->getNormal(hitPoint) );
                 newEdges.push_back( Ray(beam.getScene(), points[0], points[0]-newApex) );
                 newEdges.push_back( Ray(beam.getScene(), points[1], points[1]-newApex) );
                 newEdges.push_back( Ray(beam.getScene(), points[2], points[2]-newApex) );
                 newDistribution = Beam::Triangular2;
                 break;
             case Material::METALLIC:
-                newApex  = mirror( beam.getApex() );
-                newPivot = new Ray( adjustedPivot.bounceMetallic(this, hitPoint) );
+                newApex  = part->mirror( beam.getApex() );
+                newPivot = new Ray( adjustedPivot.bounceMetallic(part, hitPoint) );
                 for ( std::vector< Ray >::const_iterator e = beam.getEdges().begin(); e != beam.getEdges().end(); e++ )
-                    newEdges.push_back( e->bounceMetallic(this) );
+                    newEdges.push_back( e->bounceMetallic(part) );
                 newDistribution = beam.getDistribution();
                 break;
             case Material::REFLECT:
-                newApex  = mirror( beam.getApex() );
-                newPivot = new Ray( adjustedPivot.bounceReflect(this, hitPoint) );
+                newApex  = part->mirror( beam.getApex() );
+                newPivot = new Ray( adjustedPivot.bounceReflect(part, hitPoint) );
                 for ( std::vector< Ray >::const_iterator e = beam.getEdges().begin(); e != beam.getEdges().end(); e++ )
-                    newEdges.push_back( e->bounceReflect(this) );
+                    newEdges.push_back( e->bounceReflect(part) );
                 newDistribution = beam.getDistribution();
                 break;
             case Material::REFRACT:
                 newApex  = beam.getApex();
-                newPivot = new Ray( adjustedPivot.bounceRefract(this, hitPoint) );
-                if      ( !newMedium && getNormal(hitPoint) * newPivot->getDirection() < 0 )
-                    newMedium = static_cast<const Thing*>( parent ); // Beam entering refractive Thing
-                else if (  newMedium && getNormal(hitPoint) * newPivot->getDirection() > 0 )
+                newPivot = new Ray( adjustedPivot.bounceRefract(part, hitPoint) );
+                if      ( !newMedium && part->getNormal(hitPoint) * newPivot->getDirection() < 0 )
+                    newMedium = thing; // Beam entering refractive Thing
+                else if (  newMedium && part->getNormal(hitPoint) * newPivot->getDirection() > 0 )
                     newMedium = NULL; // Beam leaving refractive Thing
                 for ( std::vector< Ray >::const_iterator e = beam.getEdges().begin(); e != beam.getEdges().end(); e++ )
-                    newEdges.push_back( e->bounceRefract(this) );
+                    newEdges.push_back( e->bounceRefract(part) );
                 newDistribution = beam.getDistribution();
                 break;
             default:
                 assert( false );
         }
         Beam newBeam( beam.getScene(),
-                      newApex, this, newMedium, *newPivot, newEdges,
+                      newApex, part, newMedium, *newPivot, newEdges,
                       newColor, newDistribution, interaction );
         return newBeam;
     }
 
+    bool ITriangle::behind( const Surface* source ) const
+    {
+        const Vector normal = ( points[1] - points[0] ).cross( points[2] - points[0] ).normalize();
+        return behindTriangle( normal, normal * points[0], source );
+    }
+
+    const BoundingBox ITriangle::getBoundingBox( const Camera* camera ) const
+    {
+        return triangleBoundingBox( points, camera );
+    }
+
+    std::vector< Vector > ITriangle::getPoints( const Vector& ) const
+    {
+        std::vector< Vector > pointsVector;
+        pointsVector.push_back( points[0] );
+        pointsVector.push_back( points[1] );
+        pointsVector.push_back( points[2] );
+        return pointsVector;
+    }
+
+    double Triangle::getTilt( const Vector& point, const Beam& parentBeam ) const
+    {
+        const Vector normal = ( points[1] - points[0] ).cross( points[2] - points[0] ).normalize();
+        if ( const IPlane* plane = dynamic_cast<const IPlane*>(parentBeam.getSource()) )
+            return 0.5 + 0.5 * (normal * plane->getNormal());
+        else
+            return abs( normal * (point - parentBeam.getApex()).normalized() );
+    }
+
+    ThingPart* Triangle::clone( const Thing* parent ) const
+    {
+        return new Triangle( parent, points[0], points[1], points[2] );
+    }
+
+    Vector Triangle::mirror( const Vector& point ) const
+    {
+        const Vector normal = ( points[1] - points[0] ).cross( points[2] - points[0] ).normalize();
+        return mirrorTriangle( normal, normal * points[0], point );
+    }
+
+    Beam Triangle::bounce( const Beam& beam, const Material::Interaction& interaction ) const
+    {
+        return bounceTriangle( this, points, beam, interaction );
+    }
+
+    double MeshTriangle::intersect( const Ray& ray ) const
+    {
+        const Vector points[3] = { getVertex(0), getVertex(1), getVertex(2) };
+        return intersectTriangle( points, parent->isBackCulled(), ray );
+    }
+
+    void MeshTriangle::intersectPacket( const RayPacket& rays, double* t ) const
+    {
+        const Vector points[3] = { getVertex(0), getVertex(1), getVertex(2) };
+        intersectTrianglePacket( points, parent->isBackCulled(), rays, t );
+    }
+
+    // A lone face would point into a Mesh its new Thing doesn't own
+    ThingPart* MeshTriangle::clone( const Thing* ) const
+    {
+        throw std::string( "a face of a Mesh cannot be copied on its own, copy the whole Mesh" );
+    }
+
+    Vector MeshTriangle::getNormal( const Vector& ) const
+    {
+        return mesh->getNormal( face );
+    }
+
+    bool MeshTriangle::behind( const Surface* source ) const
+    {
+        const Vector& normal = mesh->getNormal( face );
+        return behindTriangle( normal, normal * getVertex(0), source );
+    }
+
+    const BoundingBox MeshTriangle::getBoundingBox( const Camera* camera ) const
+    {
+        const Vector points[3] = { getVertex(0), getVertex(1), getVertex(2) };
+        return triangleBoundingBox( points, camera );
+    }
+
+    std::vector< Vector > MeshTriangle::getPoints( const Vector& ) const
+    {
+        std::vector< Vector > points;
+        points.push_back( getVertex(0) );
+        points.push_back( getVertex(1) );
+        points.push_back( getVertex(2) );
+        return points;
+    }
+
+    double MeshTriangle::getTilt( const Vector& point, const Beam& parentBeam ) const
+    {
+        const Vector& normal = mesh->getNormal( face );
+        if ( const IPlane* plane = dynamic_cast<const IPlane*>(parentBeam.getSource()) )
+            return 0.5 + 0.5 * (normal * plane->getNormal());
+        else
+            return abs( normal * (point - parentBeam.getApex()).normalized() );
+    }
+
+    Vector MeshTriangle::mirror( const Vector& point ) const
+    {
+        const Vector& normal = mesh->getNormal( face );
+        return mirrorTriangle( normal, normal * getVertex(0), point );
+    }
+
+    Beam MeshTriangle::bounce( const Beam& beam, const Material::Interaction& interaction ) const
+    {
+        const Vector points[3] = { getVertex(0), getVertex(1), getVertex(2) };
+        return bounceTriangle( this, points, beam, interaction );
+    }
+
+    Mesh::Mesh( const Thing* parent, std::vector< Vector >& vertices, std::vector< unsigned int >& indices )
+        : parent( parent )
+    {
+        assert( 0 == indices.size() % 3 );
+        this->vertices.swap( vertices );
+        std::vector< unsigned int >* const ownIndices = new std::vector< unsigned int >;
+        ownIndices->swap( indices );
+        this->indices.reset( ownIndices );
+        createFaces();
+        computeNormals();
+    }
+
+    Mesh::Mesh( const Thing* parent, std::vector< Vector >& vertices, const Mesh& topology )
+        : parent( parent )
+        , indices( topology.indices )
+    {
+        assert( vertices.size() == topology.vertices.size() );
+        this->vertices.swap( vertices );
+        createFaces();
+        computeNormals();
+    }
+
+    void Mesh::createFaces()
+    {
+        const unsigned int faceCount = indices->size() / 3;
+        faces.reserve( faceCount ); // The faces must stay put once the Thing has pointers to them
+        for ( unsigned int face = 0; face < faceCount; ++face )
+        {
+            for ( int i = 0; i < 3; ++i )
+                assert( getIndex(face, i) < getVertexCount() );
+            faces.push_back( MeshTriangle(parent, this, face) );
+        }
+    }
+
+    void Mesh::computeNormals()
+    {
+        normals.resize( getFaceCount() );
+        for ( unsigned int face = 0; face < getFaceCount(); ++face )
+        {
+            const Vector& a = getCorner( face, 0 );
+            normals[face] = ( getCorner(face, 1) - a ).cross( getCorner(face, 2) - a ).normalize();
+        }
+    }
+
+    void Mesh::move( const Vector& translation )
+    {
+        for ( std::vector< Vector >::iterator vertex = vertices.begin(); vertex != vertices.end(); vertex++ )
+            *vertex += translation; // The normals stay as they are
+    }
+
+    void Mesh::move( double theta, WorldAxis axis )
+    {
+        for ( std::vector< Vector >::iterator vertex = vertices.begin(); vertex != vertices.end(); vertex++ )
+            Surface::rotate( *vertex, theta, axis );
+        computeNormals();
+    }
+
     void LightTriangle::emitZones( std::vector< Tree<Zone>* >& out ) const
     {
         const Scene* scene = parent->getScene();
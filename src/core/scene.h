@@ -23,6 +23,7 @@
 #ifndef SILENCE_SCENE
 #define SILENCE_SCENE
 
+#include <memory>
 #include <vector>
 
 #include "aux.h"
@@ -35,6 +36,7 @@ namespace Silence {
     enum WorldAxis { AXIS_X, AXIS_Y, AXIS_Z, INVALID };
 
     class Ray;
+    struct RayPacket;
     class Scene;
     template< class T > class Tree;
     class Zone;
@@ -43,8 +45,10 @@ namespace Silence {
     class ThingPart;
     class Light;
     class LightPart;
+    class Mesh;
     typedef std::vector< Thing* >    ::const_iterator ThingIt;
     typedef std::vector< ThingPart* >::const_iterator ThingPartIt;
+    typedef std::vector< Mesh* >     ::const_iterator MeshIt;
     typedef std::vector< Light* >    ::const_iterator LightIt;
     typedef std::vector< LightPart* >::const_iterator LightPartIt;
 
@@ -52,6 +56,7 @@ namespace Silence {
     class Sphere;
     class Plane;
     class Triangle;
+    class MeshTriangle;
 
     class LightPoint;
     class LightSphere;
@@ -66,6 +71,9 @@ namespace Silence {
 
         const Scene* getScene() const { return scene; }
 
+        void setBackground( bool value ) { background = value; }
+        void setBackCulled( bool value ) { backCulled = value; }
+
         virtual RGB    getColor()        const = 0; // What color the Object appears when you look at it directly
         virtual double getTransparency() const = 0; // How much you can see through the Object
 
@@ -73,11 +81,13 @@ namespace Silence {
         virtual void move( double theta, WorldAxis axis ) const = 0; // Rotate each part
 
     protected:
-        Object( const Scene* scene ) : scene( scene ) { }
+        Object( const Scene* scene )
+            : scene( scene )
+            , background( false )
+            , backCulled( false )
+        { }
         virtual ~Object() { }
 
-        friend std::istream& operator>>( std::istream&, Scene& );
-
         const Scene* const scene;
         bool background; // A background is a Surface that may only occlude other backgrounds from any direction
         bool backCulled; // Back-face culling makes the negative side of Surfaces invisible
@@ -87,6 +97,7 @@ namespace Silence {
     class Surface {
     public:
         virtual double intersect( const Ray&     ray    ) const = 0; // Returns distance from Ray origin; a return value of zero will mean a miss
+        virtual void   intersectPacket( const RayPacket& rays, double* t ) const; // The same for each Ray of a packet, written to t
         virtual Vector getNormal( const Vector&  point  ) const = 0; // Returns the outward pointing surface normal
         virtual bool   behind   ( const Surface* source ) const = 0; // Is the point before the Surface or behind it?
         virtual const BoundingBox     getBoundingBox( const Camera* camera    ) const = 0; // Returns 2D bounding box in screen space
@@ -102,6 +113,8 @@ namespace Silence {
 
         static void rotate( Vector& point, double theta, WorldAxis axis ); // Helper function to rotate a point around a world axis
 
+        friend class Mesh;
+
     protected:
         const Object* parent;
     };
@@ -114,6 +127,7 @@ namespace Silence {
         virtual double getTilt( const Vector& point, const Beam& parentBeam ) const = 0; // Returns the dot product of the normal and a given pivot (for Lambertian reflection)
         virtual Vector mirror ( const Vector& point ) const = 0; // Returns the reflection of a given point off the plane of the shape
         virtual Beam   bounce ( const Beam& beam, const Material::Interaction& interaction ) const = 0; // Spawn next Beam after hitting this ThingPart
+        virtual ThingPart* clone( const Thing* parent ) const = 0; // A copy of the part for another Thing
     };
 
     class LightPart : virtual public Surface {
@@ -128,16 +142,20 @@ namespace Silence {
     class Thing : public Object {
     public:
         Thing( const Scene* scene ) : Object( scene ) { }
-        ~Thing()
-        {
-            for ( ThingPartIt part = partsBegin(); part != partsEnd(); part++ )
-                delete *part;
-        }
+        ~Thing();
 
         void push_back( ThingPart* part ) { parts.push_back( part ); }
+        void push_back( Mesh* mesh ); // Adds all faces of the Mesh as parts
+        void setMaterial( const Material& value ) { material = value; }
 
-        ThingPartIt partsBegin() const { return parts.begin(); }
-        ThingPartIt partsEnd()   const { return parts.end();   }
+        // Make an independent copy of the Thing for the same Scene, to be moved elsewhere and added to it.
+        // Its Meshes share their faces with the original's, only the vertices are copied
+        Thing* instantiate() const;
+
+        ThingPartIt partsBegin()  const { return parts.begin();  }
+        ThingPartIt partsEnd()    const { return parts.end();    }
+        MeshIt      meshesBegin() const { return meshes.begin(); }
+        MeshIt      meshesEnd()   const { return meshes.end();   }
 
         virtual double getTransparency()    const { return interact(Material::REFRACT); }
         virtual RGB    getColor()           const { return material.getColor(); }
@@ -148,13 +166,9 @@ namespace Silence {
         virtual void move( const Vector& translation ) const;
         virtual void move( double theta, WorldAxis axis ) const;
 
-        friend std::istream& operator>>( std::istream&, Sphere& );
-        friend std::istream& operator>>( std::istream&, Plane& );
-        friend std::istream& operator>>( std::istream&, Triangle& );
-        friend std::istream& operator>>( std::istream&, Scene& );
-
     private:
         std::vector< ThingPart* > parts;
+        std::vector< Mesh* >      meshes; // The Meshes own their faces among the parts
 
         Material material;
     };
@@ -170,6 +184,7 @@ namespace Silence {
         }
 
         void push_back( LightPart* part ) { parts.push_back( part ); }
+        void setEmission( const Triplet& value ) { emission = value; }
 
         LightPartIt    partsBegin()      const { return parts.begin(); }
         LightPartIt    partsEnd()        const { return parts.end();   }
@@ -182,12 +197,6 @@ namespace Silence {
         virtual void move( const Vector& translation ) const;
         virtual void move( double theta, WorldAxis axis ) const;
 
-        friend std::istream& operator>>( std::istream&, LightPoint& );
-        friend std::istream& operator>>( std::istream&, LightSphere& );
-        friend std::istream& operator>>( std::istream&, LightPlane& );
-        friend std::istream& operator>>( std::istream&, LightTriangle& );
-        friend std::istream& operator>>( std::istream&, Scene& );
-
     private:
         std::vector< LightPart* > parts;
 
@@ -214,9 +223,6 @@ namespace Silence {
         virtual void move( const Vector& translation ) { point += translation; }
         virtual void move( double theta, WorldAxis axis ) { rotate( point, theta, axis ); }
 
-        friend std::istream& operator>>( std::istream&, Point& );
-        friend std::istream& operator>>( std::istream&, LightPoint& );
-
     protected:
         Vector point;
     };
@@ -228,6 +234,11 @@ namespace Silence {
             , IPoint   ( parent )
             , LightPart( parent )
         { }
+        LightPoint( const Light* parent, const Vector& point )
+            : Surface  ( parent )
+            , IPoint   ( parent, point )
+            , LightPart( parent )
+        { }
 
         void emitZones( std::vector< Tree<Zone>* >& out ) const;
     };
@@ -235,6 +246,7 @@ namespace Silence {
     class ISphere : virtual public Surface {
     public:
         virtual double intersect( const Ray& ray ) const;
+        virtual void   intersectPacket( const RayPacket& rays, double* t ) const;
         virtual Vector getNormal( const Vector& point ) const { return (point - center).normalize(); }
         virtual bool   behind   ( const Surface* source ) const;
 
@@ -254,9 +266,6 @@ namespace Silence {
         virtual void move( const Vector& translation ) { center += translation; }
         virtual void move( double theta, WorldAxis axis ) { rotate( center, theta, axis ); }
 
-        friend std::istream& operator>>( std::istream&, Sphere& );
-        friend std::istream& operator>>( std::istream&, LightSphere& );
-
     protected:
         Vector center;
         double radius;
@@ -269,10 +278,16 @@ namespace Silence {
             , ISphere  ( parent )
             , ThingPart( parent )
         { }
+        Sphere     ( const Thing* parent, const Vector& center, double radius )
+            : Surface  ( parent )
+            , ISphere  ( parent, center, radius )
+            , ThingPart( parent )
+        { }
 
         double getTilt( const Vector& point, const Beam& parentBeam ) const;
         Vector mirror ( const Vector& point ) const;
         Beam   bounce ( const Beam& beam, const Material::Interaction& interaction ) const;
+        ThingPart* clone( const Thing* parent ) const;
     };
 
     class LightSphere : public ISphere, public LightPart {
@@ -282,6 +297,11 @@ namespace Silence {
             , ISphere  ( parent )
             , LightPart( parent )
         { }
+        LightSphere( const Light* parent, const Vector& center, double radius )
+            : Surface  ( parent )
+            , ISphere  ( parent, center, radius )
+            , LightPart( parent )
+        { }
 
         void emitZones( std::vector< Tree<Zone>* >& out ) const;
     };
@@ -289,6 +309,7 @@ namespace Silence {
     class IPlane : virtual public Surface {
     public:
         virtual double intersect( const Ray& ray ) const;
+        virtual void   intersectPacket( const RayPacket& rays, double* t ) const;
         virtual Vector getNormal( const Vector& ) const { return normal; }
         virtual bool   behind   ( const Surface* source ) const;
 
@@ -310,9 +331,6 @@ namespace Silence {
         virtual void move( const Vector& translation ) { offset += normal * translation; }
         virtual void move( double theta, WorldAxis axis ) { rotate( normal, theta, axis ); }
 
-        friend std::istream& operator>>( std::istream&, Plane& );
-        friend std::istream& operator>>( std::istream&, LightPlane& );
-
     protected:
         Vector normal;
         double offset; // Signed distance from Origin: sign is `+' if the normal points AWAY from Origin, `-' if it points toward it
@@ -325,6 +343,11 @@ namespace Silence {
             , IPlane   ( parent )
             , ThingPart( parent )
         { }
+        Plane     ( const Thing* parent, const Vector& normal, double offset )
+            : Surface  ( parent )
+            , IPlane   ( parent, normal, offset )
+            , ThingPart( parent )
+        { }
         // Dummy Plane ctor
         Plane     ( const Vector& normal, double offset )
             : Surface  ( NULL )
@@ -335,6 +358,7 @@ namespace Silence {
         double getTilt( const Vector& point, const Beam& parentBeam ) const;
         Vector mirror ( const Vector& point ) const;
         Beam   bounce ( const Beam& beam, const Material::Interaction& interaction ) const;
+        ThingPart* clone( const Thing* parent ) const;
     };
 
     class LightPlane : public IPlane, public LightPart {
@@ -344,6 +368,11 @@ namespace Silence {
             , IPlane   ( parent )
             , LightPart( parent )
         { }
+        LightPlane( const Light* parent, const Vector& normal, double offset )
+            : Surface  ( parent )
+            , IPlane   ( parent, normal, offset )
+            , LightPart( parent )
+        { }
 
         void emitZones( std::vector< Tree<Zone>* >& out ) const;
     };
@@ -351,6 +380,7 @@ namespace Silence {
     class ITriangle : virtual public Surface {
     public:
         virtual double intersect( const Ray& ray ) const;
+        virtual void   intersectPacket( const RayPacket& rays, double* t ) const;
         virtual Vector getNormal( const Vector& ) const
         {
             Vector edge0 = this->points[1] - this->points[0];
@@ -359,6 +389,8 @@ namespace Silence {
         }
         virtual bool behind( const Surface* source ) const;
 
+        const Vector&  getVertex( int i ) const { return points[i]; }
+
         virtual const BoundingBox getBoundingBox( const Camera* camera    ) const;
         std::vector< Vector >     getPoints     ( const Vector& viewpoint ) const;
         virtual void move( const Vector& translation )
@@ -374,9 +406,6 @@ namespace Silence {
             rotate( points[2], theta, axis );
         }
 
-        friend std::istream& operator>>( std::istream&, Triangle& );
-        friend std::istream& operator>>( std::istream&, LightTriangle& );
-
     protected:
         ITriangle( const Object* parent ) : Surface( parent ) { }
         ITriangle( const Object* parent, const Vector& a, const Vector& b, const Vector& c )
@@ -398,10 +427,16 @@ namespace Silence {
             , ITriangle( parent )
             , ThingPart( parent )
         { }
+        Triangle     ( const Thing* parent, const Vector& a, const Vector& b, const Vector& c )
+            : Surface  ( parent )
+            , ITriangle( parent, a, b, c )
+            , ThingPart( parent )
+        { }
 
         double getTilt( const Vector& point, const Beam& parentBeam ) const;
         Vector mirror ( const Vector& point ) const;
         Beam   bounce ( const Beam& beam, const Material::Interaction& interaction ) const;
+        ThingPart* clone( const Thing* parent ) const;
     };
 
     class LightTriangle : public ITriangle, public LightPart {
@@ -411,14 +446,91 @@ namespace Silence {
             , ITriangle( parent )
             , LightPart( parent )
         { }
+        LightTriangle( const Light* parent, const Vector& a, const Vector& b, const Vector& c )
+            : Surface  ( parent )
+            , ITriangle( parent, a, b, c )
+            , LightPart( parent )
+        { }
 
         void emitZones( std::vector< Tree<Zone>* >& out ) const;
     };
 
+    // A single face of a Mesh. Its corners are kept by the Mesh, shared with the neighbouring faces
+    class MeshTriangle : public ThingPart {
+    public:
+        MeshTriangle( const Thing* parent, const Mesh* mesh, unsigned int face )
+            : Surface  ( parent )
+            , ThingPart( parent )
+            , mesh     ( mesh )
+            , face     ( face )
+        { }
+
+        virtual double intersect( const Ray& ray ) const;
+        virtual void   intersectPacket( const RayPacket& rays, double* t ) const;
+        virtual Vector getNormal( const Vector& ) const;
+        virtual bool   behind   ( const Surface* source ) const;
+
+        const Mesh*    getMesh()   const { return mesh; }
+        unsigned int   getFace()   const { return face; }
+        const Vector&  getVertex( int i ) const;
+
+        virtual const BoundingBox getBoundingBox( const Camera* camera    ) const;
+        std::vector< Vector >     getPoints     ( const Vector& viewpoint ) const;
+        virtual void move( const Vector& )     { } // The Mesh moves all of its vertices at once
+        virtual void move( double, WorldAxis ) { }
+
+        double getTilt( const Vector& point, const Beam& parentBeam ) const;
+        Vector mirror ( const Vector& point ) const;
+        Beam   bounce ( const Beam& beam, const Material::Interaction& interaction ) const;
+        ThingPart* clone( const Thing* parent ) const; // Throws: faces are copied along with their Mesh, see Thing::instantiate
+
+    private:
+        const Mesh*  mesh;
+        unsigned int face;
+    };
+
+    // Indexed triangle mesh: a shared array of vertices and three indices into it for each face.
+    // Face normals are computed up front and kept up to date as the Mesh moves
+    class Mesh {
+    public:
+        // Takes over the contents of both arrays. The indices must all be smaller than the number of vertices
+        Mesh( const Thing* parent, std::vector< Vector >& vertices, std::vector< unsigned int >& indices );
+        // Takes over the vertices but shares the faces of another Mesh with as many vertices, like an instance of it
+        Mesh( const Thing* parent, std::vector< Vector >& vertices, const Mesh& topology );
+
+        const Thing*  getParent()      const { return parent; }
+        unsigned int  getVertexCount() const { return vertices.size(); }
+        unsigned int  getFaceCount()   const { return faces.size(); }
+        const std::vector< Vector >& getVertices() const { return vertices; }
+        const Vector& getVertex( unsigned int i ) const { return vertices[i]; }
+        const Vector& getCorner( unsigned int face, int i ) const { return vertices[ (*indices)[3 * face + i] ]; }
+        unsigned int  getIndex ( unsigned int face, int i ) const { return (*indices)[3 * face + i]; }
+        const Vector& getNormal( unsigned int face ) const { return normals[face]; }
+        MeshTriangle* getFace  ( unsigned int face )       { return &faces[face]; }
+        bool          sharesFaces( const Mesh& other ) const { return indices == other.indices; }
+
+        void move( const Vector& translation );
+        void move( double theta, WorldAxis axis );
+
+    private:
+        Mesh( const Mesh& );            // Not copyable, the faces point back to the Mesh
+        Mesh& operator=( const Mesh& );
+
+        void createFaces();
+        void computeNormals();
+
+    private:
+        const Thing* const            parent;
+        std::vector< Vector >         vertices;
+        std::shared_ptr< const std::vector< unsigned int > > indices; // Shared by the instances of the Mesh
+        std::vector< Vector >         normals; // One for each face
+        std::vector< MeshTriangle >   faces;
+    };
+
+    inline const Vector& MeshTriangle::getVertex( int i ) const { return mesh->getCorner( face, i ); }
+
     struct Sky {
         RGB color; // Skies are not allowed to be emitters
-
-        friend std::istream& operator>>( std::istream&, Sky& );
     };
 
     class Scene {
@@ -439,6 +551,11 @@ namespace Silence {
 
         const Sky& getSky() const { return sky; }
 
+        // Build a Scene without a scene file. The Scene takes ownership of the Objects
+        void add( Light* light ) { assert( this == light->getScene() ); lights.push_back( light ); setChanged(); }
+        void add( Thing* thing ) { assert( this == thing->getScene() ); things.push_back( thing ); setChanged(); }
+        void setSky( const RGB& color ) { sky.color = color; setChanged(); }
+
         bool isChanged()    const { return changed; }
         void clearChanged() const { changed = false; }
 
@@ -447,7 +564,6 @@ namespace Silence {
 
         friend class Light;
         friend class Thing;
-        friend std::istream& operator>>( std::istream&, Scene& );
 
     private:
         std::vector< Light* > lights;
@@ -22,10 +22,13 @@
 
 #include "shadow.h"
 
+#include "stats.h"
+
 namespace Silence {
 
     double Shadow::occluded( const Vector& point ) const
     {
+        Stats::count( Stats::SHADOW_OCCLUDED );
         if ( umbra.containsNew(point) )
             return 1;
         if ( penumbra.containsNew(point) )
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Stats class methods
+// Part of Silence, an experimental rendering engine
+
+#include "stats.h"
+
+#include <iomanip>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "perthread.h"
+
+namespace Silence {
+
+    std::atomic< bool > Stats::enabled( false );
+
+    static const char* const COUNTERNAMES[Stats::COUNTERS] = {
+        "zonesCreated", "zonesPruned", "shadows", "beamContains", "beamContainsNew", "shadowOccluded", "pixelsTouched"
+    };
+
+    // Each thread counts in a Block of its own, they are only summed up when read
+    struct Block {
+        Block()
+        {
+            for ( int i = 0; i < Stats::COUNTERS; ++i )
+                counts[i] = 0;
+        }
+
+        void merge( const Block& other )
+        {
+            for ( int i = 0; i < Stats::COUNTERS; ++i )
+                counts[i] += other.counts[i];
+        }
+
+        long counts[Stats::COUNTERS];
+    };
+
+    static std::mutex                                       lock; // Of the phases, the counters have their own
+    static std::vector< std::pair< std::string, double > >  phases;
+
+    void Stats::add( Counter counter, long n )
+    {
+        PerThread< Block >::local().counts[counter] += n;
+    }
+
+    long Stats::getCount( Counter counter )
+    {
+        long total = 0;
+        PerThread< Block >::visit( [&]( const Block& block ) { total += block.counts[counter]; } );
+        return total;
+    }
+
+    void Stats::reset()
+    {
+        PerThread< Block >::visit( []( Block& block ) { block = Block(); } );
+        std::lock_guard< std::mutex > guard( lock );
+        phases.clear();
+    }
+
+    void Stats::time( const std::string& phase, double seconds )
+    {
+        std::lock_guard< std::mutex > guard( lock );
+        for ( std::vector< std::pair< std::string, double > >::iterator p = phases.begin(); p != phases.end(); p++ )
+            if ( p->first == phase )
+            {
+                p->second += seconds;
+                return;
+            }
+        phases.push_back( std::make_pair(phase, seconds) );
+    }
+
+    void Stats::writeJson( std::ostream& os, const std::string& name )
+    {
+        long counts[COUNTERS];
+        for ( int i = 0; i < COUNTERS; ++i )
+            counts[i] = getCount( Counter(i) );
+        std::lock_guard< std::mutex > guard( lock );
+        const std::streamsize precision = os.precision( 6 );
+        os << "{" << std::endl;
+        if ( !name.empty() )
+        {
+            os << "    \"name\": \"";
+            for ( std::string::const_iterator c = name.begin(); c != name.end(); c++ )
+                if ( '"' == *c || '\\' == *c )
+                    os << '\\' << *c;
+                else if ( (unsigned char)*c < 0x20 )
+                    os << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' ) << (int)*c << std::dec << std::setfill( ' ' );
+                else
+                    os << *c;
+            os << "\"," << std::endl;
+        }
+        os << "    \"phases\": {";
+        for ( std::vector< std::pair< std::string, double > >::const_iterator p = phases.begin(); p != phases.end(); p++ )
+            os << ( p == phases.begin() ? "" : "," ) << std::endl << "        \"" << p->first << "\": " << std::fixed << p->second;
+        os << std::endl << "    }," << std::endl << "    \"counters\": {";
+        for ( int i = 0; i < COUNTERS; ++i )
+            os << ( i ? "," : "" ) << std::endl << "        \"" << COUNTERNAMES[i] << "\": " << counts[i];
+        os << "," << std::endl << "        \"shadowsPerZone\": " << ( counts[ZONES_CREATED] ? (double)counts[SHADOWS] / counts[ZONES_CREATED] : 0 );
+        os << std::endl << "    }" << std::endl << "}" << std::endl;
+        os.unsetf( std::ios::floatfield );
+        os.precision( precision );
+    }
+
+}
+
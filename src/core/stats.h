@@ -0,0 +1,92 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Stats class: optional timers and counters of the rendering process for performance reports
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_STATS
+#define SILENCE_STATS
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace Silence {
+
+    // Everything is off until enable() is called, and then counting is cheap enough for the inner
+    // loops: each thread adds to its own counters and they are only summed up when read
+    class Stats {
+    public:
+        enum Counter {
+            ZONES_CREATED,     // Including the roots emitted by the Lights
+            ZONES_PRUNED,      // Leaves not followed any further because of the cutoff
+            SHADOWS,           // Kept by the Zones after bouncing
+            BEAM_CONTAINS,     // Calls to Beam::contains
+            BEAM_CONTAINS_NEW, // Calls to Beam::containsNew
+            SHADOW_OCCLUDED,   // Calls to Shadow::occluded
+            PIXELS_TOUCHED,    // Pixels some Zone's source was seen through
+            COUNTERS
+        };
+
+        static void enable( bool on = true ) { enabled = on; }
+        static bool isEnabled() { return enabled.load( std::memory_order_relaxed ); }
+        static void reset(); // Zero all counters and forget all timings
+
+        static void count( Counter counter, long n = 1 )
+        {
+            if ( isEnabled() )
+                add( counter, n );
+        }
+        static long getCount( Counter counter );
+
+        // Add to the time spent in a phase. Phases are reported in the order they first appeared
+        static void time( const std::string& phase, double seconds );
+
+        // Times the rest of the enclosing block as a phase
+        class Timer {
+        public:
+            Timer( const std::string& phase )
+                : phase( phase )
+                , start( std::chrono::steady_clock::now() )
+            { }
+            ~Timer()
+            {
+                if ( isEnabled() )
+                    Stats::time( phase, std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count() );
+            }
+
+        private:
+            const std::string                           phase;
+            const std::chrono::steady_clock::time_point start;
+        };
+
+        // A single JSON object with "phases" in seconds and "counters", labelled with a "name" if given
+        static void writeJson( std::ostream& os, const std::string& name = "" );
+
+    private:
+        static void add( Counter counter, long n );
+
+        static std::atomic< bool > enabled;
+    };
+
+}
+
+#endif // SILENCE_STATS
+
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Trace class methods
+// Part of Silence, an experimental rendering engine
+
+#include "trace.h"
+
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+#include "perthread.h"
+
+namespace Silence {
+
+    typedef std::chrono::steady_clock Clock;
+
+    std::atomic< bool > Trace::enabled( false );
+
+    struct Span {
+        const char* name;
+        const char* argName;
+        long        arg;
+        long long   start;
+        long long   end;
+        int         thread;
+    };
+
+    // Each thread records in a Log of its own, numbered when it records its first Span
+    struct Log {
+        Log()
+            : thread( -1 )
+        { }
+
+        void merge( const Log& other ) { spans.insert( spans.end(), other.spans.begin(), other.spans.end() ); }
+
+        std::vector< Span > spans;
+        int                 thread;
+    };
+
+    static std::mutex            lock; // Of the epoch, the Logs have their own
+    static std::atomic< int >    threadCount( 0 );
+    static Clock::time_point     epoch;
+    static bool                  started = false;
+
+    void Trace::enable( bool on )
+    {
+        {
+            std::lock_guard< std::mutex > guard( lock );
+            if ( on && !started )
+            {
+                epoch   = Clock::now();
+                started = true;
+            }
+        }
+        enabled = on;
+    }
+
+    void Trace::clear()
+    {
+        PerThread< Log >::visit( []( Log& log ) { log.spans.clear(); } );
+    }
+
+    long long Trace::now()
+    {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - epoch ).count();
+    }
+
+    void Trace::record( const char* name, const char* argName, long arg, long long start, long long end )
+    {
+        Log& log = PerThread< Log >::local();
+        if ( -1 == log.thread )
+            log.thread = threadCount++;
+        const Span span = { name, argName, arg, start, end, log.thread };
+        log.spans.push_back( span );
+    }
+
+    // Complete events ("X") carry both the beginning and the end of a span
+    static void writeSpan( std::ostream& os, const Span& span )
+    {
+        os << "{\"name\": \"" << span.name << "\", \"cat\": \"silence\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << span.thread
+           << ", \"ts\": " << span.start / 1000 << "." << std::setw( 3 ) << std::setfill( '0' ) << span.start % 1000
+           << ", \"dur\": " << (span.end - span.start) / 1000 << "." << std::setw( 3 ) << (span.end - span.start) % 1000 << std::setfill( ' ' );
+        if ( span.argName )
+            os << ", \"args\": {\"" << span.argName << "\": " << span.arg << "}";
+        os << "}";
+    }
+
+    void Trace::writeJson( std::ostream& os )
+    {
+        os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        bool first = true;
+        PerThread< Log >::visit( [&]( const Log& log )
+        {
+            for ( std::vector< Span >::const_iterator span = log.spans.begin(); span != log.spans.end(); span++ )
+            {
+                os << ( first ? "" : "," ) << std::endl;
+                writeSpan( os, *span );
+                first = false;
+            }
+        } );
+        os << std::endl << "]}" << std::endl;
+    }
+
+}
+
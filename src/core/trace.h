@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Trace class: an optional timeline of what each thread was doing, for viewing in a trace viewer
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_TRACE
+#define SILENCE_TRACE
+
+#include <atomic>
+#include <ostream>
+
+namespace Silence {
+
+    // Spans of time are recorded by each thread on its own and written out together in
+    // Chrome's trace event format (as read by chrome://tracing or Perfetto). While recording
+    // is off a Scope costs a single flag check
+    class Trace {
+    public:
+        static void enable( bool on = true ); // Timestamps start from the first time it's switched on
+        static bool isEnabled() { return enabled.load( std::memory_order_relaxed ); }
+        static void clear(); // Not while other threads are recording
+
+        // Records the rest of the enclosing block as a span. Names (and argument names) must be
+        // string literals, they are only written out at the very end
+        class Scope {
+        public:
+            Scope( const char* name, const char* argName = NULL, long arg = 0 )
+                : name( name )
+                , argName( argName )
+                , arg( arg )
+                , active( isEnabled() )
+                , start( active ? now() : 0 )
+            { }
+            ~Scope()
+            {
+                if ( active )
+                    record( name, argName, arg, start, now() );
+            }
+
+        private:
+            Scope( const Scope& );
+            Scope& operator=( const Scope& );
+
+            const char* const name;
+            const char* const argName;
+            const long        arg;
+            const bool        active;
+            const long long   start;
+        };
+
+        // A JSON object with the "traceEvents" of all threads. Not while other threads are recording
+        static void writeJson( std::ostream& os );
+
+    private:
+        static long long now(); // Nanoseconds since recording started
+        static void record( const char* name, const char* argName, long arg, long long start, long long end );
+
+        static std::atomic< bool > enabled;
+    };
+
+}
+
+#endif // SILENCE_TRACE
+
@@ -22,9 +22,10 @@
 
 #include "triplet.h"
 
-#include <cstdlib>
 #include <limits>
 
+#include "random.h"
+
 namespace Silence {
 
     std::ostream& operator<<( std::ostream& os, const Triplet& triplet )
@@ -45,15 +46,15 @@ namespace Silence {
     }
 
     // Returns a random unit vector whose dot product with 'normal' is non-negative
-    Vector Vector::random( const Vector& normal )
+    Vector Vector::random( const Vector& normal, Random& generator )
     {
         double x;
         double y;
         double z;
         do {
-            x = (double)std::rand() / RAND_MAX * 2 - 1;
-            y = (double)std::rand() / RAND_MAX * 2 - 1;
-            z = (double)std::rand() / RAND_MAX;
+            x = generator.uniform( -1, 1 );
+            y = generator.uniform( -1, 1 );
+            z = generator.uniform();
         } while ( 1 < x*x + y*y + z*z || (!x && !y && !z) );
 
         Vector tangentialX, tangentialY;
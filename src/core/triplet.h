@@ -31,10 +31,14 @@
 
 namespace Silence {
 
+    class Random;
+
     struct Triplet {
         explicit Triplet( double x = 0, double y = 0, double z = 0 ) : x(x), y(y), z(z) { }
         Triplet( const Triplet& other ) : x(other.x), y(other.y), z(other.z) { }
 
+        Triplet& operator= ( const Triplet& other )       { x = other.x; y = other.y; z = other.z; return *this; }
+
         bool     operator==( const Triplet& other ) const { return  equal( x, other.x ) &&  equal( y, other.y ) &&  equal( z, other.z ); }
         bool     operator!=( const Triplet& other ) const { return !equal( x, other.x ) || !equal( y, other.y ) || !equal( z, other.z ); }
 
@@ -123,7 +127,8 @@ namespace Silence {
                                                                         z*other.x - other.z*x,
                                                                         x*other.y - other.x*y ); } // Vector product
 
-        static Vector random( const Vector& normal );
+        // Draws from the caller's own generator, so the result only depends on that generator's stream
+        static Vector random( const Vector& normal, Random& generator );
 
         static const Vector Zero;
         static const Vector UnitX;
@@ -23,9 +23,12 @@
 #include "zone.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 
 #include "scene.h"
+#include "stats.h"
+#include "trace.h"
 
 namespace Silence {
 
@@ -158,6 +161,7 @@ namespace Silence {
         for ( std::vector< Shadow >::const_iterator shadow = newShadows.begin(); shadow != newShadows.end(); shadow++ )
             if ( !eclipsed(shadow->getSource()) )
                 shadows.push_back( *shadow );
+        Stats::count( Stats::SHADOWS, shadows.size() );
 
         for ( std::vector< Beam >::const_iterator beam = newBeams.begin(); beam != newBeams.end(); beam++ )
             newZones.push_back( new Zone(*beam) );
@@ -165,57 +169,54 @@ namespace Silence {
     }
 
     // Contribute to the final image in a Camera
-    int Zone::rasterize( Camera* camera ) const
+    // (and to the images of our own tree level and Light if the Camera keeps them)
+    int Zone::rasterize( Camera* camera, int level, int lightIndex ) const
     {
-        const int width  = camera->getGridwidth();
-        const int height = camera->getGridheight();
-        const Vector viewpoint = camera->getViewpoint();
+        const BoundingBox window = camera->getCrop();
+        const Vector viewpoint   = camera->getViewpoint();
 
-        bool cameraHit = light.contains( viewpoint ) && !camera->behind( light.getApex() );
+        if ( !light.contains( viewpoint ) || camera->behind( light.getApex() ) )
+            return 0;
 
-        if ( cameraHit )
-            for ( std::vector< Shadow >::const_iterator shadow = shadows.begin(); shadow != shadows.end(); ++shadow )
+        // Don't bother with the shadows if the Zone is off the Screen (or the cropped part of it)
+        const BoundingBox bb = light.source->getBoundingBox( camera );
+        const int rowMin = max( window.topLeft.row,     bb.topLeft.row );
+        const int rowMax = min( window.bottomRight.row, bb.bottomRight.row );
+        const int colMin = max( window.topLeft.col,     bb.topLeft.col );
+        const int colMax = min( window.bottomRight.col, bb.bottomRight.col );
+        if ( rowMax <= rowMin || colMax <= colMin )
+            return 0;
+
+        bool cameraHit = true;
+        for ( std::vector< Shadow >::const_iterator shadow = shadows.begin(); shadow != shadows.end(); ++shadow )
+        {
+            if ( equal( 1, (*shadow).occluded(viewpoint) ) )
             {
-                if ( equal( 1, (*shadow).occluded(viewpoint) ) )
-                {
-                    cameraHit = false;
-                    break;
-                }
+                cameraHit = false;
+                break;
             }
+        }
 
         if ( cameraHit )
         {
-            RGB** pixelBuffer = new RGB*[height];
-            for ( int row = 0; row < height; ++row )
-                pixelBuffer[row] = new RGB[width];
-            double** skyBlocked = new double*[height];
-            for ( int row = 0; row < height; ++row )
-                skyBlocked[row] = new double[width];
-
-            const BoundingBox bb = light.source->getBoundingBox( camera );
-            const int rowMin = max( 0, bb.topLeft.row );
-            const int rowMax = min( height, bb.bottomRight.row );
-            const int colMin = max( 0, bb.topLeft.col );
-            const int colMax = min( width, bb.bottomRight.col );
-            for ( int row = rowMin; row < rowMax; ++row )
-                rasterizeRow( camera, bb, row, pixelBuffer[row], skyBlocked[row] );
-            // Write results directly in Camera's pixels array:
+            // Write results directly in Camera's Framebuffers:
             // contributions from all Zones will be superimposed on each other
-            for ( int row = 0; row < height; ++row )
-                for ( int col = 0; col < width; ++col )
-                {
-                    if ( RGB::Black != pixelBuffer[row][col] )
-                        camera->pixels[row][col] += pixelBuffer[row][col];
-                    if ( !equal(0, skyBlocked[row][col]) )
-                        camera->skyMask[row][col] -= skyBlocked[row][col];
-                }
+            Framebuffer* targets[3] = { &camera->frame, NULL, NULL };
+            int targetCount = 1;
+            if ( 0 <= level && level < camera->getLevelCount() )
+                targets[targetCount++] = &camera->levels[level];
+            if ( 0 <= lightIndex && lightIndex < camera->getLightCount() )
+                targets[targetCount++] = &camera->lights[lightIndex];
+            Framebuffer* const costs = camera->hasCostMap() ? &camera->costs : NULL;
 
-            for ( int i = 0; i < height; ++i )
-                delete[] pixelBuffer[i];
-            delete[] pixelBuffer;
-            for ( int i = 0; i < height; ++i )
-                delete[] skyBlocked[i];
-            delete[] skyBlocked;
+            // Rows never overlap so they can go in parallel
+            #pragma omp parallel
+            {
+                Trace::Scope trace( "rasterize rows", "level", level );
+                #pragma omp for schedule(dynamic)
+                for ( int row = rowMin; row < rowMax; ++row )
+                    rasterizeRow( camera, row, colMin, colMax, window.topLeft, targets, targetCount, costs );
+            }
 
             return (rowMax - rowMin) * (colMax - colMin);
         }
@@ -259,57 +260,83 @@ namespace Silence {
         return false;
     }
 
-    Triplet Zone::getColor( const Ray& eyeray ) const
-    {
-        if ( !light.contains(eyeray.getOrigin()) )
-            return RGB::Black;
-        return light.getColor() * getIntensity( NULL, eyeray );
-    }
-
-    // Walk back up the Zone tree to see how much light is radiated in the viewing direction
-    double Zone::getIntensity( const Surface* surface, const Ray& eyeray ) const
+    // Walk back up the Zone tree with several eye Rays at once. Every pixel of a Zone has the
+    // same ancestors, so the packet stays together all the way up, minus the Rays that drop out
+    void Zone::getIntensity( const Surface* surface, const RayPacket& eyerays, const double* sourceT, double* intensities,
+                             int* shadowTests ) const
     {
         const Surface*    source = light.getSource();
         const Tree<Zone>* parent = node->getParent();
-        // Check total occlusion before going any further
-        const double shadowTerm = ( 1 - occluded(surface, eyeray.getOrigin(), source->getParent()->isBackground()) );
-        if ( equal(0, shadowTerm) )
-            return 0; // Point is fully in the dark
+        const bool    background = source->getParent()->isBackground();
+        double shadowTerms[PACKETSIZE];
+        for ( int i = 0; i < eyerays.count; ++i )
+            shadowTerms[i] = 1 - occluded( surface, eyerays.getOrigin(i), background, shadowTests ? shadowTests + i : NULL );
         // LightPoints are a special case, they normally can't be hit
         const LightPoint* lightpoint = dynamic_cast<const LightPoint*>( source );
-        // Need to test if we hit the emitter at all first
-        const double sourceT = lightpoint ? (lightpoint->getPoint() - eyeray.getOrigin()).length() : source->intersect( eyeray );
-        if ( sourceT < EPSILON )
-            return 0; // No hit
+        double sourceTs[PACKETSIZE];
+        if ( sourceT )
+            std::copy( sourceT, sourceT + eyerays.count, sourceTs );
+        else if ( lightpoint )
+            for ( int i = 0; i < eyerays.count; ++i )
+                sourceTs[i] = (lightpoint->getPoint() - eyerays.getOrigin(i)).length();
+        else
+            source->intersectPacket( eyerays, sourceTs );
         if ( NULL == parent )
-            return shadowTerm; // We are in a root Zone
-        const Vector sourcePoint = eyeray[ sourceT ];
-        const Beam&  parentBeam  = (**parent).light;
+        {
+            // We are in a root Zone
+            for ( int i = 0; i < eyerays.count; ++i )
+                intensities[i] = equal(0, shadowTerms[i]) || sourceTs[i] < EPSILON ? 0 : shadowTerms[i];
+            return;
+        }
+        const Beam&  parentBeam = (**parent).light;
         const ThingPart* part = dynamic_cast<const ThingPart*>( source );
         assert( part );
-        Vector       nextDirection;
-        const Thing* nextMedium = NULL;
         const Material::Interaction kind = light.getKind();
-        switch ( kind )
+        const Thing* nextMedium = Material::REFRACT == kind && !light.getMedium() ? parentBeam.getMedium() : NULL;
+        RayPacket nextEyerays( scene, nextMedium );
+        int    lanes[PACKETSIZE]; // Where each Ray of the next packet came from
+        double terms[PACKETSIZE][4];
+        for ( int i = 0; i < eyerays.count; ++i )
         {
-            case Material::DIFFUSE:  nextDirection = parentBeam.getPivot().getOrigin() - sourcePoint; break;
-            case Material::METALLIC: nextDirection = eyeray.bounceMetallic( part, sourcePoint ).getDirection(); break;
-            case Material::REFLECT:  nextDirection = eyeray.bounceReflect ( part, sourcePoint ).getDirection(); break;
-            case Material::REFRACT:  nextDirection = eyeray.bounceRefract ( part, sourcePoint ).getDirection();
-                                     if ( !light.getMedium() ) nextMedium = parentBeam.getMedium(); break;
-            default: assert( false );
+            intensities[i] = 0;
+            if ( equal(0, shadowTerms[i]) || sourceTs[i] < EPSILON )
+                continue; // Point is fully in the dark or the emitter is missed
+            const Ray    eyeray      = eyerays[i];
+            const Vector sourcePoint = eyeray[ sourceTs[i] ];
+            Vector nextDirection;
+            switch ( kind )
+            {
+                case Material::DIFFUSE:  nextDirection = parentBeam.getPivot().getOrigin() - sourcePoint; break;
+                case Material::METALLIC: nextDirection = eyeray.bounceMetallic( part, sourcePoint ).getDirection(); break;
+                case Material::REFLECT:  nextDirection = eyeray.bounceReflect ( part, sourcePoint ).getDirection(); break;
+                case Material::REFRACT:  nextDirection = eyeray.bounceRefract ( part, sourcePoint ).getDirection(); break;
+                default: assert( false );
+            }
+            const Ray nextEyeray( scene, sourcePoint, nextDirection, nextMedium );
+            const int next = nextEyerays.count;
+            lanes[next]    = i;
+            terms[next][0] = shadowTerms[i];
+            terms[next][1] = Material::DIFFUSE  == kind ? (*parentBeam.distribution)( parentBeam.pivot, nextEyeray.getOrigin() ) : 1;
+            terms[next][2] = Material::DIFFUSE  == kind ? part->getTilt( sourcePoint, parentBeam ) : 1;
+            terms[next][3] = Material::METALLIC == kind ? light.fresnelIntensity( eyeray, sourcePoint ) : 1;
+            nextEyerays.push_back( nextEyeray );
         }
-        Ray nextEyeray( scene, sourcePoint, nextDirection, nextMedium );
-        const double diffuseTerm = Material::DIFFUSE  == kind ? (*parentBeam.distribution)( parentBeam.pivot, nextEyeray.getOrigin() ) : 1;
-        const double    tiltTerm = Material::DIFFUSE  == kind ? part->getTilt( sourcePoint, parentBeam ) : 1; // cos(angle of receiving surface)
-        const double fresnelTerm = Material::METALLIC == kind ? light.fresnelIntensity( eyeray ) : 1;
+        if ( 0 == nextEyerays.count )
+            return;
         // Recursion
-        const double aggregateIntensity = (**parent).getIntensity( source, nextEyeray ) * shadowTerm *
-                                          diffuseTerm * tiltTerm * fresnelTerm;
-        return aggregateIntensity;
+        double parentIntensities[PACKETSIZE];
+        int    parentTests[PACKETSIZE];
+        if ( shadowTests )
+            std::fill( parentTests, parentTests + nextEyerays.count, 0 );
+        (**parent).getIntensity( source, nextEyerays, NULL, parentIntensities, shadowTests ? parentTests : NULL );
+        for ( int next = 0; next < nextEyerays.count; ++next )
+            intensities[lanes[next]] = parentIntensities[next] * terms[next][0] * terms[next][1] * terms[next][2] * terms[next][3];
+        if ( shadowTests )
+            for ( int next = 0; next < nextEyerays.count; ++next )
+                shadowTests[lanes[next]] += parentTests[next];
     }
 
-    double Zone::occluded( const Surface* surface, const Vector& point, bool background ) const
+    double Zone::occluded( const Surface* surface, const Vector& point, bool background, int* tests ) const
     {
         double occlusion = 0;
         for ( std::vector< Shadow >::const_iterator shadow = shadows.begin(); shadow != shadows.end(); shadow++ )
@@ -319,6 +346,8 @@ namespace Silence {
             if ( !background && shadow->getSource()->getParent()->isBackground() )
                 continue; // Backgrounds cannot occlude non-backgrounds
             // This ignores the complications arising from overlapping occluders
+            if ( tests )
+                ++*tests;
             occlusion += (*shadow).occluded( point );
             if ( 1 <= occlusion )
                 break;
@@ -326,24 +355,77 @@ namespace Silence {
         return min( 1, occlusion );
     }
 
-    void Zone::rasterizeRow( const Camera* camera, const BoundingBox& bb, int row, RGB* pixelBuffer, double* skyBlocked ) const
+    void Zone::rasterizeRow( const Camera* camera, int row, int colMin, int colMax, const ScreenPoint& origin,
+                             Framebuffer* const* targets, int targetCount, Framebuffer* costs ) const
     {
         const int    gridwidth    = camera->getGridwidth();
         const Vector viewpoint    = camera->getViewpoint();
         const Vector leftEdge     = camera->getLeftEdge ( row );
         const Vector rowDirection = camera->getRightEdge( row ) - leftEdge;
         const double transparency = light.getSource()->getParent()->getTransparency();
-        for ( int col = max(0, bb.topLeft.col); col < min(gridwidth, bb.bottomRight.col); ++col )
+        long         touched      = 0;
+        // Trace the row PACKETSIZE pixels at a time
+        for ( int first = colMin; first < colMax; first += PACKETSIZE )
         {
-            const Vector screenPoint = leftEdge + rowDirection * ( (double)col/gridwidth );
-            const Ray eyeray( scene, screenPoint, screenPoint - viewpoint );
-            const double sourceT = light.getSource()->intersect( eyeray );
-            if ( 0 != sourceT  )
+            const std::chrono::steady_clock::time_point start = costs ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            RayPacket eyerays( scene );
+            for ( int col = first; col < colMax && eyerays.count < PACKETSIZE; ++col )
+            {
+                const Vector screenPoint = leftEdge + rowDirection * ( (double)col/gridwidth );
+                eyerays.push_back( Ray(scene, screenPoint, screenPoint - viewpoint) );
+            }
+            double sourceT[PACKETSIZE];
+            light.getSource()->intersectPacket( eyerays, sourceT );
+            // Only the pixels inside the Beam are lit, but all the ones that see the source are covered
+            RayPacket litEyerays( scene );
+            int    litCols[PACKETSIZE];
+            double litSourceT[PACKETSIZE];
+            for ( int i = 0; i < eyerays.count; ++i )
+                if ( 0 != sourceT[i] && light.contains(eyerays.getOrigin(i)) )
+                {
+                    litCols[litEyerays.count]    = first + i;
+                    litSourceT[litEyerays.count] = sourceT[i];
+                    litEyerays.push_back( eyerays[i] );
+                }
+            double intensities[PACKETSIZE];
+            int    shadowTests[PACKETSIZE] = { 0 };
+            if ( litEyerays.count )
+                getIntensity( NULL, litEyerays, litSourceT, intensities, costs ? shadowTests : NULL );
+            for ( int i = 0; i < litEyerays.count; ++i )
             {
-                pixelBuffer[col] = getColor( eyeray ).normalize(); // Squash values into (0, 0, 0)..(1, 1, 1)
-                skyBlocked [col] = 1 - transparency;
+                const int     col   = litCols[i];
+                const Triplet color = light.getColor() * intensities[i]; // Linear, clamped only when the Framebuffer is resolved
+                for ( int t = 0; t < targetCount; ++t )
+                {
+                    float* pixel = targets[t]->getRow( row - origin.row ) + 3 * (col - origin.col);
+                    pixel[0] += color.x;
+                    pixel[1] += color.y;
+                    pixel[2] += color.z;
+                }
+            }
+            for ( int i = 0; i < eyerays.count; ++i )
+                if ( 0 != sourceT[i] )
+                {
+                    const int col = first + i;
+                    for ( int t = 0; t < targetCount; ++t )
+                        targets[t]->getSkyRow( row - origin.row )[col - origin.col] += 1 - transparency;
+                    ++touched;
+                }
+            if ( costs )
+            {
+                // Red: Zones, green: Shadow tests, blue: microseconds shared evenly by the packet
+                float* const pixels = costs->getRow( row - origin.row ) + 3 * (first - origin.col);
+                const float  time   = std::chrono::duration< float, std::micro >( std::chrono::steady_clock::now() - start ).count() / eyerays.count;
+                for ( int i = 0; i < eyerays.count; ++i )
+                {
+                    pixels[3*i + 0] += 0 != sourceT[i];
+                    pixels[3*i + 2] += time;
+                }
+                for ( int i = 0; i < litEyerays.count; ++i )
+                    pixels[3 * (litCols[i] - first) + 1] += shadowTests[i];
             }
         }
+        Stats::count( Stats::PIXELS_TOUCHED, touched );
     }
 
 }
@@ -30,6 +30,8 @@
 namespace Silence {
 
     struct BoundingBox;
+    struct Framebuffer;
+    struct ScreenPoint;
     class  Plane;
     class  ThingPart;
 
@@ -63,10 +65,12 @@ namespace Silence {
         std::vector< Zone* > bounce();                          // Generate child Zones
 
         // Phase Two
-        int     rasterize   ( Camera*        camera ) const; // Returs the number of paths used
-        Triplet getColor    ( const Ray&     eyeray ) const;
-        double  getIntensity( const Surface* surface, const Ray& eyeray ) const;
-        double  occluded    ( const Surface* surface, const Vector& point, bool background = true ) const;
+        int     rasterize   ( Camera*        camera, int level = -1, int lightIndex = -1 ) const; // Returs the number of paths used
+        // Walk back up the Zone tree to see how much light is radiated towards a packet of eye Rays.
+        // If sourceT is given it holds where they hit our source. The number of Shadow tests run for each Ray is added to shadowTests if given
+        void    getIntensity( const Surface* surface, const RayPacket& eyerays, const double* sourceT, double* intensities,
+                              int* shadowTests = NULL ) const;
+        double  occluded    ( const Surface* surface, const Vector& point, bool background = true, int* tests = NULL ) const;
 
     private:
         void setNode( const Tree<Zone>* n ) { node = n; }
@@ -76,7 +80,10 @@ namespace Silence {
         bool hit     ( const Surface* Surface ) const; // Is a surface element reached by the light?
         bool eclipsed( const Surface* surface ) const; // Is a surface element completely obscured?
 
-        void rasterizeRow( const Camera* camera, const BoundingBox& bb, int row, RGB* pixelBuffer, double* skyBlocked ) const;
+        // Columns and rows are on the Camera's grid, 'origin' is where the Framebuffers start on it.
+        // What each pixel cost is added to 'costs' if given (see Camera::setCostMap)
+        void rasterizeRow( const Camera* camera, int row, int colMin, int colMax, const ScreenPoint& origin,
+                           Framebuffer* const* targets, int targetCount, Framebuffer* costs ) const;
 
     private:
         const Scene* const scene;
@@ -25,9 +25,12 @@
 #include <GL/gl.h>
 #include <GL/glut.h>
 
-#include <ctime>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 #include "../core/camera.h"
+#include "../core/renderer.h"
 #include "../core/triplet.h"
 
 namespace Silence {
@@ -36,40 +39,48 @@ namespace Silence {
     const int    GUI::moveAndTurnTime = 10;
     const double GUI::moveStep        =  1;
     const double GUI::turnStep        =  0.1;
+    const int    GUI::maxDivisor      = 16;
 
     GUI* GUI::self = NULL;
 
+    GUI::~GUI()
+    {
+        stopRendering();
+        delete renderer;
+        delete front;
+        delete back;
+        for ( std::vector< Motion* >::iterator m = motions.begin(); m != motions.end(); m++ )
+            delete *m;
+    }
+
     void GUI::redisplay()
     {
-        const RGB** pixels = self->camera->getPixels();
-        const int   width  = self->camera->getGridwidth();
-        const int   height = self->camera->getGridheight();
-        float* floatPixels = new float[ width * height * 3 ];
-        for ( int row = 0; row < height; ++row )
-            for ( int col = 0; col < width; ++col )
-            {
-                // OpenGL counts rows from the bottom up
-                floatPixels[ row*width*3 + col*3 + 0 ] = pixels[ height - row - 1 ][ col ].x;
-                floatPixels[ row*width*3 + col*3 + 1 ] = pixels[ height - row - 1 ][ col ].y;
-                floatPixels[ row*width*3 + col*3 + 2 ] = pixels[ height - row - 1 ][ col ].z;
-            }
-        glRasterPos2i( -1, -1 );
-        glDrawPixels( self->camera->getGridwidth(), self->camera->getGridheight(), GL_RGB, GL_FLOAT, floatPixels );
-        delete[] floatPixels;
+        const int width  = self->camera->getGridwidth();
+        const int height = self->camera->getGridheight();
+        {
+            std::lock_guard< std::mutex > lock( self->mutex );
+            // Hand over the Camera's image as it is: OpenGL counts rows from the bottom up
+            // so start at the top left corner and draw downwards
+            glPixelStorei( GL_UNPACK_ROW_LENGTH, self->front->getStride() );
+            // and scale it up if it was rendered at a lower resolution
+            glRasterPos2i( -1, 1 );
+            glPixelZoom( (float)width / self->front->getGridwidth(), -(float)height / self->front->getGridheight() );
+            glDrawPixels( self->front->getGridwidth(), self->front->getGridheight(), GL_RGB, GL_FLOAT, self->front->getImage() );
+            glPixelZoom( 1, 1 );
+        }
 
         if ( self->hud )
         {
-            self->hudFrames++;
-            const clock_t now = clock();
-            if ( 1 < (double)(now - self->lastHudRefresh) / CLOCKS_PER_SEC - 0.001 * self->hudClockErrorSinceHudRefresh )
+            const Clock::time_point now = Clock::now();
+            if ( 1 <= std::chrono::duration< double >(now - self->lastHudRefresh).count() )
             {
-                self->hudTime = (double)(now - self->lastCameraClear) / CLOCKS_PER_SEC - 0.001 * self->hudClockErrorSinceCameraClear;
-                if ( 0 < self->hudTime )
-                    self->hudFps = self->hudFrames / self->hudTime + 0.5;
+                const double sinceClear = std::chrono::duration< double >(now - self->lastCameraClear).count();
+                self->hudTime = sinceClear;
+                if ( 0 < sinceClear )
+                    self->hudFps = self->hudFrames / sinceClear + 0.5;
                 else
                     self->hudFps = 0;
                 self->lastHudRefresh = now;
-                self->hudClockErrorSinceHudRefresh = 0;
             }
             glColor3f( 1.0, 1.0, 0.4 );
             char fpsText[32];
@@ -105,31 +116,24 @@ namespace Silence {
         if ( -1 == self->windowId )
             return;
         glutTimerFunc( self->refreshTime, &refresh, 0 );
-        const clock_t now = clock();
-        const Camera::RenderInfo* renderInfo /*= renderInfo*/ = new Camera::RenderInfo;
-        if ( self->keys.any() || renderInfo->sceneChanged )
+        if ( self->frameReady.exchange(false) )
         {
-            self->lastCameraClear               = now;
-            self->hudClockErrorSinceCameraClear = 0;
-            self->hudFrames                     = 0;
+            self->hudFrames++;
+            glutPostRedisplay();
         }
-        self->clockError                    += renderInfo->clockError;
-        self->hudClockErrorSinceHudRefresh  += renderInfo->clockError;
-        self->hudClockErrorSinceCameraClear += renderInfo->clockError;
-        delete renderInfo;
-        glutPostRedisplay();
     }
 
+    // Only keep track of time here, the render thread moves the Objects between frames
     void GUI::moveObjects( int )
     {
         if ( -1 == self->windowId )
             return;
         glutTimerFunc( self->moveObjectsTime, &moveObjects, 0 );
-        const clock_t now = clock();
-        const double  elapsedTime = (double)(now - self->lastMoveObjects) / CLOCKS_PER_SEC - 0.001 * self->clockError;
-        for ( std::vector< Motion* >::iterator m = self->motions.begin(); m != self->motions.end(); m++ )
-            (*m)->step( elapsedTime );
-        self->clockError      = 0;
+        const Clock::time_point now = Clock::now();
+        {
+            std::lock_guard< std::mutex > lock( self->mutex );
+            self->pendingTime += std::chrono::duration< double >( now - self->lastMoveObjects ).count();
+        }
         self->lastMoveObjects = now;
     }
 
@@ -137,6 +141,16 @@ namespace Silence {
     {
         glutTimerFunc( self->moveAndTurnTime, &moveAndTurnCamera, 0 );
 
+        const bool moving = self->keys.any();
+        std::unique_lock< std::mutex > lock( self->mutex );
+        if ( moving != self->moving )
+        {
+            self->moving = moving;
+            self->wakeUp.notify_one();
+        }
+        if ( !moving )
+            return;
+
         if ( self->keys.w     && !self->keys.s     ) self->camera->move(    -moveStep, Camera::AXIS_Z );
         if ( self->keys.W     && !self->keys.S     ) self->camera->move( -10*moveStep, Camera::AXIS_Z );
         if ( self->keys.a     && !self->keys.d     ) self->camera->move(    -moveStep, Camera::AXIS_X );
@@ -166,6 +180,17 @@ namespace Silence {
         if ( self->keys.Y )                          self->camera->turn( -turnStep, Camera::AXIS_Y );
         if ( self->keys.z )                          self->camera->turn(  turnStep, Camera::AXIS_Z );
         if ( self->keys.Z )                          self->camera->turn( -turnStep, Camera::AXIS_Z );
+
+        // The frame in progress is out of date now. Low resolution frames are quick
+        // so let them finish, otherwise we'd never get to see anything while moving
+        self->dirty = true;
+        const bool cancel = !self->interactiveFrame;
+        lock.unlock();
+        if ( cancel )
+            self->renderer->cancel();
+        self->wakeUp.notify_one();
+        self->lastCameraClear = Clock::now();
+        self->hudFrames       = 0;
     }
 
     void GUI::handleKeyPress( unsigned char key, int, int )
@@ -221,14 +246,30 @@ namespace Silence {
             case  27: // Escape key
             case 'q':
             case 'Q':
+                stopRendering();
                 glutDestroyWindow( self->windowId );
                 self->windowId = -1;
                 break;
             default :
-                ;
+                if ( '1' <= key && key <= '9' )
+                    toggleLight( key - '1' );
         }
     }
 
+    // Switch a Light on or off without rendering the Scene again
+    void GUI::toggleLight( unsigned int i )
+    {
+        std::lock_guard< std::mutex > lock( self->mutex );
+        if ( self->lightScales.size() <= i )
+            return;
+        if ( RGB::Black == self->lightScales[i] )
+            self->lightScales[i] = RGB::White;
+        else
+            self->lightScales[i] = RGB::Black;
+        self->front->relight( self->lightScales, self->gamma );
+        glutPostRedisplay();
+    }
+
     void GUI::handleKeyRelease( unsigned char key, int, int )
     {
         switch ( key ) {
@@ -257,7 +298,7 @@ namespace Silence {
             case 'Z': self->keys.Z = false; break;
             case  27: // Escape key
             case 'q':
-            case 'Q': glutDestroyWindow( self->windowId ); self->windowId = -1; break;
+            case 'Q': stopRendering(); glutDestroyWindow( self->windowId ); self->windowId = -1; break;
             default : ;
         }
     }
@@ -310,30 +351,110 @@ namespace Silence {
         glutSwapBuffers();
     }
 
-    void GUI::setup( int depth, double gamma, int refreshTime, bool hud, const std::vector< Motion* >& motions )
+    void GUI::setup( int depth, int level, double cutoff, double gamma, int refreshTime, bool hud, const std::vector< Motion* >& motions )
     {
         this->depth       = depth;
+        this->level       = level;
+        this->cutoff      = cutoff;
         this->gamma       = gamma;
         this->refreshTime = refreshTime;
         this->hud         = hud;
         this->motions     = motions;
+        const Scene* scene = camera->getScene();
+        this->lightScales.assign( scene->lightsEnd() - scene->lightsBegin(), RGB::White );
+        front = new Camera( scene );
+        back  = new Camera( scene );
+        front->setPose( *camera );
+        back ->setPose( *camera );
+        front->setLightCount( lightScales.size() );
+        back ->setLightCount( lightScales.size() );
     }
 
     void GUI::run()
     {
-        this->clockError                    = 0;
-        this->hudClockErrorSinceHudRefresh  = 0;
-        this->hudClockErrorSinceCameraClear = 0;
-        this->hudFrames                     = 0;
-        this->hudFps                        = 0;
-        this->hudZones                      = 0;
-        this->hudTime                       = 0;
-        this->lastMoveObjects = this->lastHudRefresh = this->lastCameraClear = clock();
+        this->hudFrames = 0;
+        this->hudFps    = 0;
+        this->hudZones  = 0;
+        this->hudTime   = 0;
+        this->lastMoveObjects = this->lastHudRefresh = this->lastCameraClear = Clock::now();
+        renderer = new Renderer( camera->getScene() );
+        renderer->addCamera( back );
+        renderThread = std::thread( &renderLoop );
+        atexit( &stopRendering ); // GLUT may exit without returning from its main loop
         glutTimerFunc( refreshTime,     &refresh,           0 );
         glutTimerFunc( moveObjectsTime, &moveObjects,       0 );
         glutTimerFunc( moveAndTurnTime, &moveAndTurnCamera, 0 );
         glutMainLoop();
     }
 
-}
+    // Render frames one after the other into the back Camera until told to quit.
+    // The Scene is only ever touched from this thread.
+    // While the Camera is moving frames are rendered at a fraction of the full resolution,
+    // small enough to keep up with the requested framerate. Once it stops the image is
+    // refined step by step until it's back to full resolution
+    void GUI::renderLoop()
+    {
+        const double frameTime  = 0.001 * self->refreshTime;
+        const double fullPixels = (double)self->camera->getGridwidth() * self->camera->getGridheight();
+        double pixelCost = 0;    // Seconds per rendered pixel, measured as we go
+        int    divisor   = 1;    // Resolution divisor of the last frame started
+        bool   refined   = true; // The front frame is up to date and at full resolution
+        while ( true )
+        {
+            {
+                std::unique_lock< std::mutex > lock( self->mutex );
+                // Nothing to do if nothing moves
+                while ( !self->quit && !self->dirty && self->motions.empty() && refined )
+                    self->wakeUp.wait( lock );
+                if ( self->quit )
+                    return;
+                if ( self->dirty || !self->motions.empty() )
+                {
+                    divisor = 1;
+                    if ( self->moving && 0 < pixelCost )
+                        divisor = std::min( maxDivisor, (int)std::ceil(std::sqrt(pixelCost * fullPixels / frameTime)) );
+                }
+                else
+                    divisor = std::max( 1, divisor / 2 );
+                self->interactiveFrame = self->moving;
+                self->dirty = false;
+                for ( std::vector< Motion* >::iterator m = self->motions.begin(); m != self->motions.end(); m++ )
+                    (*m)->step( self->pendingTime );
+                self->pendingTime = 0;
+                self->back->setPose( *self->camera, divisor );
+            }
+            refined = false;
+            const Clock::time_point start = Clock::now();
+            if ( !self->renderer->render( 0, self->depth, self->level, self->cutoff, self->gamma ) )
+                continue; // Cancelled, start over with the new pose
+            const double elapsed = std::chrono::duration< double >( Clock::now() - start ).count();
+            const double pixels  = (double)self->back->getGridwidth() * self->back->getGridheight();
+            pixelCost = 0 < pixelCost ? (pixelCost + elapsed / pixels) / 2 : elapsed / pixels;
+            refined   = 1 == divisor;
+
+            std::lock_guard< std::mutex > lock( self->mutex );
+            if ( self->lightScales.end() != std::find_if( self->lightScales.begin(), self->lightScales.end(),
+                                                          []( const Triplet& scale ) { return !(RGB::White == scale); } ) )
+                self->back->relight( self->lightScales, self->gamma );
+            std::swap( self->front, self->back );
+            self->renderer->removeCamera( 0 );
+            self->renderer->addCamera( self->back );
+            self->frameReady = true;
+        }
+    }
 
+    // Wait for the render thread to finish, abandoning the frame in progress
+    void GUI::stopRendering()
+    {
+        if ( !self->renderThread.joinable() )
+            return;
+        {
+            std::lock_guard< std::mutex > lock( self->mutex );
+            self->quit = true;
+        }
+        self->renderer->cancel();
+        self->wakeUp.notify_one();
+        self->renderThread.join();
+    }
+
+}
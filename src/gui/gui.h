@@ -23,7 +23,12 @@
 #ifndef SILENCE_GUI
 #define SILENCE_GUI
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "motion.h"
@@ -31,9 +36,12 @@
 namespace Silence {
 
     class Camera;
+    class Renderer;
 
     class GUI {
 
+        typedef std::chrono::steady_clock Clock;
+
         struct KeysPressed {
             bool w, W, a, A, s, S, d, D;
             bool h, H, j, J, k, K, l, L;
@@ -54,17 +62,22 @@ namespace Silence {
     public:
         GUI( Camera* camera )
             : camera( camera )
+            , front( NULL )
+            , back( NULL )
+            , renderer( NULL )
             , windowId( -1 )
             , depth( -1 )
+            , level( -1 )
+            , cutoff( -1 )
             , gamma( -1 )
             , refreshTime( -1 )
             , hud( false )
-            , lastMoveObjects( -1 )
-            , clockError( -1 )
-            , lastHudRefresh( -1 )
-            , lastCameraClear( -1 )
-            , hudClockErrorSinceHudRefresh( -1 )
-            , hudClockErrorSinceCameraClear( -1 )
+            , quit( false )
+            , dirty( true )
+            , moving( false )
+            , interactiveFrame( false )
+            , pendingTime( 0 )
+            , frameReady( false )
             , hudFrames( -1 )
             , hudFps( -1 )
             , hudZones( -1 )
@@ -80,14 +93,10 @@ namespace Silence {
             keys.x  = keys.X    = keys.y    = keys.Y     =
                                   keys.z    = keys.Z     = false;
         }
-        ~GUI()
-        {
-            for ( std::vector< Motion* >::iterator m = motions.begin(); m != motions.end(); m++ )
-                delete *m;
-        }
+        ~GUI();
 
         void initialize( int* argc, char* argv[] );
-        void setup( int depth, double gamma, int refreshTime /*millisecs*/, bool hud, const std::vector< Motion* >& motions );
+        void setup( int depth, int level, double cutoff, double gamma, int refreshTime /*millisecs*/, bool hud, const std::vector< Motion* >& motions );
         void run();
 
     private:
@@ -100,37 +109,55 @@ namespace Silence {
         static void handleArrowKeyPress( int key, int, int );
         static void handleArrowKeyRelease( int key, int, int );
         static void undoReshape( int, int );
+        static void toggleLight( unsigned int i );
+        static void renderLoop();
+        static void stopRendering();
 
     private:
         static const int    moveObjectsTime;
         static const int    moveAndTurnTime;
         static const double moveStep;
-        static const double turnStep; // Radians
+        static const double turnStep;   // Radians
+        static const int    maxDivisor; // Lowest resolution while moving is 1/maxDivisor of the full
 
         // Member function pointers are not function pointers so we need this hack
         static GUI* self;
 
-        Camera*     camera;
+        Camera*     camera; // Moved around by the user, never rendered to
+        Camera*     front;  // The last finished frame, on display
+        Camera*     back;   // The frame in progress
+        Renderer*   renderer;
         int         windowId;
         KeysPressed keys;
 
         int         depth;
+        int         level;
+        double      cutoff;
         double      gamma;
         int         refreshTime;
         bool        hud;
         std::vector< Motion* > motions;
+        std::vector< Triplet > lightScales; // Relighting factors for each Light, see Camera::relight (guarded by mutex)
+
+        // Shared with the render thread, guarded by mutex
+        std::thread             renderThread;
+        std::mutex              mutex;
+        std::condition_variable wakeUp;
+        bool                    quit;             // The render thread should finish
+        bool                    dirty;            // The Camera moved since the last frame was started
+        bool                    moving;           // Keys are held down to move the Camera
+        bool                    interactiveFrame; // The frame in progress was started while moving
+        double                  pendingTime;      // Seconds the Motions are behind
+        std::atomic< bool >     frameReady;       // A new frame was swapped to the front
 
         // Bookkeeping
-        clock_t     lastMoveObjects;
-        int         clockError; // Millisecs
-        clock_t     lastHudRefresh;
-        clock_t     lastCameraClear;
-        int         hudClockErrorSinceHudRefresh;  // Millisecs
-        int         hudClockErrorSinceCameraClear; // Millisecs
-        int         hudFrames;
-        int         hudFps;
-        int         hudZones;
-        int         hudTime;
+        Clock::time_point lastMoveObjects;
+        Clock::time_point lastHudRefresh;
+        Clock::time_point lastCameraClear;
+        int               hudFrames;
+        int               hudFps;
+        int               hudZones;
+        int               hudTime;
     };
 
 }
@@ -23,22 +23,16 @@
 #include "motion.h"
 
 #include <cmath>
-#include <cstdlib>
 
 namespace Silence {
 
     void BrownianMotion::step( double dt ) const
     {
-        double x = std::rand() * 2;
-        if ( RAND_MAX < x )
-            x = RAND_MAX - x;
-        double y = std::rand() * 2;
-        if ( RAND_MAX < y )
-            y = RAND_MAX - y;
-        double z = std::rand() * 2;
-        if ( RAND_MAX < z )
-            z = RAND_MAX - z;
-        Vector delta = Vector( x, y, z ).normalized() * scale;
+        Vector direction;
+        do {
+            direction = Vector( random.uniform(-1, 1), random.uniform(-1, 1), random.uniform(-1, 1) );
+        } while ( !direction.x && !direction.y && !direction.z );
+        Vector delta = direction.normalized() * scale;
 
         object->move( delta * dt );
     }
@@ -23,6 +23,7 @@
 #ifndef SILENCE_MOTION
 #define SILENCE_MOTION
 
+#include "../core/random.h"
 #include "../core/scene.h"
 #include "../core/triplet.h"
 
@@ -41,18 +42,21 @@ namespace Silence {
         const Object* const object;
     };
 
-    // Random motion each time
+    // Random motion each time. Motions with different streams wander independently,
+    // ones with the same stream (and global seed) take the very same steps
     class BrownianMotion : public Motion {
     public:
-        BrownianMotion( const Object* object, double scale = 1.0 )
+        BrownianMotion( const Object* object, double scale = 1.0, unsigned int stream = 0 )
             : Motion( object )
             , scale( scale )
+            , random( stream )
         { }
 
         virtual void step( double dt ) const;
 
     private:
         double scale;
+        mutable Random random;
     };
 
     // Move in a constant direction at constant speed
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The parts of libsilence that the command line program doesn't need
+// Part of Silence, an experimental rendering engine
+
+#include "silence.h"
+
+namespace Silence {
+
+    // The program embedding the library has no command line to set these
+    struct flags modeFlags = { false };
+
+    bool renderToBuffer( Renderer& renderer, const Camera& camera, float* pixels, int depth, int level,
+                         double cutoff, double gamma, bool linear )
+    {
+        Camera* const added = renderer.findCamera( &camera );
+        if ( !added || !renderer.renderCamera(added, 0, depth, level, cutoff, gamma) )
+            return false;
+        camera.readPixels( pixels, linear );
+        return true;
+    }
+
+    RenderStats getStats( const Renderer& renderer )
+    {
+        RenderStats stats;
+        stats.buildTime     = renderer.getBuildTime();
+        stats.rasterizeTime = renderer.getRasterizeTime();
+        stats.zones         = renderer.getZoneCount();
+        stats.paths         = renderer.getPathCount();
+        return stats;
+    }
+
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The interface of libsilence for programs that embed the renderer
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_LIBRARY
+#define SILENCE_LIBRARY
+
+#include "../core/camera.h"
+#include "../core/material.h"
+#include "../core/renderer.h"
+#include "../core/scene.h"
+#include "../core/triplet.h"
+
+#include "../parser/parsescene.h"
+
+namespace Silence {
+
+    // A Scene is either loaded with parseSceneFile or parseScene (from a stream or straight from memory)
+    // or put together by hand: new Light/Thing( scene ), add parts to them, Scene::add them
+    // and set up a Camera with the four corners of its Screen. A Renderer keeps the Zones
+    // of its Scene between frames, so keep it around if you're rendering more than once
+
+    struct RenderStats {
+        double buildTime;     // Seconds spent building Zones
+        double rasterizeTime; // Seconds spent rasterizing them
+        int    zones;
+        long   paths;         // Pixels shaded so far by the Renderer
+    };
+
+    // Render a frame and copy it to caller memory: gridwidth * gridheight * 3 floats, row by row.
+    // Only this Camera is rendered, and it must have been added to the Renderer.
+    // Returns false if it wasn't or if the frame was cancelled
+    bool renderToBuffer( Renderer& renderer, const Camera& camera, float* pixels, int depth, int level = -1,
+                         double cutoff = 0, double gamma = 1, bool linear = false );
+
+    RenderStats getStats( const Renderer& renderer );
+
+}
+
+#endif // SILENCE_LIBRARY
@@ -20,25 +20,43 @@
 // The main function. Parses command line flags, reads the input scene file and runs the actual tracer
 // Part of Silence, an experimental rendering engine
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <sstream>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <thread>
 #include <cstdlib>
+#include <chrono>
 #include <ctime>
+#include <future>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "core/camera.h"
+#include "core/image.h"
+#include "core/random.h"
 #include "core/renderer.h"
 #include "core/scene.h"
+#include "core/stats.h"
+#include "core/trace.h"
 
+#include "gui/motion.h"
 #ifdef COMPILE_WITH_GUI
 #include "gui/gui.h"
-#include "parser/parsemotions.h"
 #endif
 
+#include "parser/compiledscene.h"
+#include "parser/parsemotions.h"
 #include "parser/parsescene.h"
 
+#include "server/server.h"
+
 using namespace Silence;
 
 const std::string VERSION = "pre-alpha";
@@ -49,14 +67,37 @@ struct arguments {
     char*  progname;
     int    depth;
     int    level;
+    bool   splitLevels;
+    bool   costMap;
     double cutoff;
     double gamma;
     char*  sceneFilename;
+    std::vector< char* > inputs; // Positional arguments: the scene file, the tiles to merge or the shards to gather
     char*  outFilename;
+    char*  compileFilename;
+    char*  motionsFilename;
+    char*  statsFilename;
+    char*  traceFilename;
+    int    benchmarkFrames;
+    int    firstFrame;
+    int    lastFrame;
+    double dt;
+    unsigned long seed;
+    bool   seeded;
+    bool   dumpFrames;
+    bool   serve;
+    char*  socketFilename;
+    int    workers;
+    int    cacheSize;
+    int    cropX, cropY, cropWidth, cropHeight;
+    bool   merge;
+    int    shardIndex;
+    int    shardCount;
+    int    shards;
+    bool   gather;
 #ifdef COMPILE_WITH_GUI
     bool   gui;
     int    fps;
-    char*  motionsFilename;
     bool   hud;
 #endif
 };
@@ -67,13 +108,42 @@ void help( std::string progname )
     std::cout << "Command line options:" << std::endl;
     std::cout << "  -d, --depth DEPTH   Set the maximal depth (length) of any path (default 6)" << std::endl;
     std::cout << "  -l, --level LEVEL   Show only an exact level of the tree (unset by default)" << std::endl;
+    std::cout << "      --split-levels  Also write each level of the tree to its own image (FILENAME_levelN.ppm)" << std::endl;
+    std::cout << "      --costs         Also write what each pixel cost to render to FILENAME_costs.pfm: the number of" << std::endl;
+    std::cout << "                      Zones covering it, Shadow tests run for it and microseconds spent on it as R, G, B" << std::endl;
     std::cout << "  -c, --cutoff LIMIT  Stop following Zones with less intensity than LIMIT (unset by default)" << std::endl;
     std::cout << "  -g, --gamma EXP     Set the exponent for post-mortem gamma correction (default 1.0)" << std::endl;
     std::cout << "  -o, --out FILENAME  Set the filename for the output image (default image.ppm)" << std::endl;
+    std::cout << "                      The extension selects the format: .ppm (binary PPM), .pfm (linear HDR floats) or .qoi" << std::endl;
+    std::cout << "      --compile FILEN Write the scene in compiled binary form to FILEN and quit. Compiled scenes" << std::endl;
+    std::cout << "                      load much faster and are accepted anywhere a scene file is" << std::endl;
+    std::cout << "      --crop X,Y,W,H  Only render the W by H rectangle of the grid at X,Y into an image of that size" << std::endl;
+    std::cout << "      --merge         Put together tiles rendered with --crop, given as TILE_FILENAME@X,Y in place" << std::endl;
+    std::cout << "                      of SCENE_FILENAME, into the --out image" << std::endl;
+    std::cout << "      --shards N      Split the Zone trees among N worker processes and add up their Framebuffers" << std::endl;
+    std::cout << "      --shard I/N     Only render the I-th of N shards and write its linear Framebuffer to the --out file" << std::endl;
+    std::cout << "      --gather        Add up the Framebuffers written by --shard, given after SCENE_FILENAME, into the --out image" << std::endl;
+    std::cout << "      --stats FILEN   Write the time spent in each phase of the render and some counts of the work done" << std::endl;
+    std::cout << "                      to FILEN as JSON (\"-\" for standard output)" << std::endl;
+    std::cout << "      --trace FILEN   Record what each thread is doing over time and write it to FILEN in Chrome's" << std::endl;
+    std::cout << "                      trace event format (\"-\" for standard output)" << std::endl;
+    std::cout << "  -m, --motions FILEN Set the file describing how the surfaces move" << std::endl;
+    std::cout << "      --benchmark N   Render N frames offscreen, stepping the motions in between, and report frame times" << std::endl;
+    std::cout << "      --animate A:B   Render frames A to B of the motions to numbered images (FILENAME_frameN.ppm)" << std::endl;
+    std::cout << "      --dt SECONDS    Set the time step between benchmark or animation frames (default 0.1)" << std::endl;
+    std::cout << "      --dump-frames   Also write each benchmark frame to its own image (FILENAME_frameN.ppm)" << std::endl;
+    std::cout << "      --seed N        Seed the random numbers (of Brownian motions for instance) with N to make runs" << std::endl;
+    std::cout << "                      repeatable (default: the current time)" << std::endl;
+    std::cout << "      --serve         Keep running and render jobs read from standard input, one JSON object per line" << std::endl;
+    std::cout << "                      Jobs have \"scene\" and \"output\" filenames and optional \"id\", \"camera\", \"depth\"," << std::endl;
+    std::cout << "                      \"level\", \"cutoff\" and \"gamma\" settings. SCENE_FILENAME and the options above" << std::endl;
+    std::cout << "                      are the defaults. Replies are written to standard output, one per line" << std::endl;
+    std::cout << "      --listen SOCKET Like --serve, but take jobs from connections to a Unix domain socket" << std::endl;
+    std::cout << "      --workers N     Set how many jobs the server renders at once (default: number of cores)" << std::endl;
+    std::cout << "      --cache N       Set how many scenes the server keeps loaded (default 8)" << std::endl;
 #ifdef COMPILE_WITH_GUI
     std::cout << "      --gui           Start interactive graphical interface instead of outputting to file" << std::endl;
     std::cout << "  -f, --fps FPS       Set the framerate for the graphical interface (default 10)" << std::endl;
-    std::cout << "  -m, --motions FILEN Set the file describing how the surfaces move" << std::endl;
     std::cout << "      --hud           Show performance info in top left corner" << std::endl;
 #endif
     std::cout << "  -h, --help          Print this help message and quit" << std::endl;
@@ -100,7 +170,14 @@ void version()
 void usage( std::string progname )
 {
     std::cerr << "usage: " << progname << " SCENE_FILENAME [-v|--verbose] [--depth MAX_DEPTH_OF_PATHS]" << std::endl;
-    std::cerr << "  [--level LEVEL] [--cutoff LIMIT] [--gamma GAMMA] [--out IMAGE_FILENAME]" << std::endl;
+    std::cerr << "  [--level LEVEL] [--split-levels] [--cutoff LIMIT] [--gamma GAMMA] [--out IMAGE_FILENAME] [--crop X,Y,W,H]" << std::endl;
+    std::cerr << "  [--shards N | --shard I/N]" << std::endl;
+    std::cerr << "  [--motions MOTIONS_FILENAME] [--benchmark FRAMES [--dt SECONDS] [--dump-frames]]" << std::endl;
+    std::cerr << "  [--animate FIRST:LAST [--dt SECONDS]]" << std::endl;
+    std::cerr << "usage: " << progname << " [SCENE_FILENAME] --serve|--listen SOCKET [--workers N] [--cache N] [OPTIONS]" << std::endl;
+    std::cerr << "usage: " << progname << " --merge [--out IMAGE_FILENAME] TILE_FILENAME@X,Y..." << std::endl;
+    std::cerr << "usage: " << progname << " SCENE_FILENAME --compile COMPILED_FILENAME" << std::endl;
+    std::cerr << "usage: " << progname << " --gather [--gamma GAMMA] [--crop X,Y,W,H] [--out IMAGE_FILENAME] SCENE_FILENAME SHARD_FILENAME..." << std::endl;
 #ifdef COMPILE_WITH_GUI
     std::cerr << "  [--gui]" << std::endl;
 #endif
@@ -139,12 +216,16 @@ void parseArgs( int argc, char* argv[], struct arguments* args )
             if ( args->level < 0 )
                 usage( args->progname );
         }
+        else if( !strcmp(argv[i], "--split-levels") )
+        {
+            args->splitLevels = true;
+        }
         else if( !strcmp(argv[i], "-c") || !strcmp(argv[i], "--cutoff") )
         {
             if ( argc <= ++i )
                 usage( args->progname );
             args->cutoff = atof( argv[i] );
-            if ( !args->cutoff < 0 )
+            if ( args->cutoff < 0 )
                 usage( args->progname );
         }
         else if( !strcmp(argv[i], "-g") || !strcmp(argv[i], "--gamma") )
@@ -161,18 +242,45 @@ void parseArgs( int argc, char* argv[], struct arguments* args )
                 usage( args->progname );
             args->outFilename = argv[i];
         }
-#ifdef COMPILE_WITH_GUI
-        else if( !strcmp(argv[i], "--gui") )
+        else if( !strcmp(argv[i], "--compile") )
         {
-            args->gui = true;
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->compileFilename = argv[i];
         }
-        else if( !strcmp(argv[i], "-f") || !strcmp(argv[i], "--fps") )
+        else if( !strcmp(argv[i], "--crop") )
         {
             if ( argc <= ++i )
                 usage( args->progname );
-            args->fps = atoi( argv[i] );
-            if ( !args->fps )
+            if ( 4 != sscanf( argv[i], "%d,%d,%d,%d", &args->cropX, &args->cropY, &args->cropWidth, &args->cropHeight ) )
+                usage( args->progname );
+            if ( args->cropX < 0 || args->cropY < 0 || args->cropWidth <= 0 || args->cropHeight <= 0 )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--merge") )
+        {
+            args->merge = true;
+        }
+        else if( !strcmp(argv[i], "--shards") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->shards = atoi( argv[i] );
+            if ( args->shards <= 0 )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--shard") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            if ( 2 != sscanf( argv[i], "%d/%d", &args->shardIndex, &args->shardCount ) )
                 usage( args->progname );
+            if ( args->shardIndex < 0 || args->shardCount <= args->shardIndex )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--gather") )
+        {
+            args->gather = true;
         }
         else if( !strcmp(argv[i], "-m") || !strcmp(argv[i], "--motions") )
         {
@@ -180,6 +288,105 @@ void parseArgs( int argc, char* argv[], struct arguments* args )
                 usage( args->progname );
             args->motionsFilename = argv[i];
         }
+        else if( !strcmp(argv[i], "--benchmark") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->benchmarkFrames = atoi( argv[i] );
+            if ( args->benchmarkFrames <= 0 )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--animate") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            if ( 2 != sscanf( argv[i], "%d:%d", &args->firstFrame, &args->lastFrame ) )
+            {
+                // Just a number of frames
+                args->firstFrame = 0;
+                args->lastFrame  = atoi( argv[i] ) - 1;
+            }
+            if ( args->firstFrame < 0 || args->lastFrame < args->firstFrame )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--dt") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->dt = atof( argv[i] );
+            if ( args->dt < 0 )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--dump-frames") )
+        {
+            args->dumpFrames = true;
+        }
+        else if( !strcmp(argv[i], "--costs") )
+        {
+            args->costMap = true;
+        }
+        else if( !strcmp(argv[i], "--stats") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->statsFilename = argv[i];
+        }
+        else if( !strcmp(argv[i], "--trace") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->traceFilename = argv[i];
+        }
+        else if( !strcmp(argv[i], "--seed") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            char* end;
+            args->seed   = strtoul( argv[i], &end, 10 );
+            args->seeded = true;
+            if ( end == argv[i] || *end )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--serve") )
+        {
+            args->serve = true;
+        }
+        else if( !strcmp(argv[i], "--listen") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->serve          = true;
+            args->socketFilename = argv[i];
+        }
+        else if( !strcmp(argv[i], "--workers") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->workers = atoi( argv[i] );
+            if ( args->workers <= 0 )
+                usage( args->progname );
+        }
+        else if( !strcmp(argv[i], "--cache") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->cacheSize = atoi( argv[i] );
+            if ( args->cacheSize <= 0 )
+                usage( args->progname );
+        }
+#ifdef COMPILE_WITH_GUI
+        else if( !strcmp(argv[i], "--gui") )
+        {
+            args->gui = true;
+        }
+        else if( !strcmp(argv[i], "-f") || !strcmp(argv[i], "--fps") )
+        {
+            if ( argc <= ++i )
+                usage( args->progname );
+            args->fps = atoi( argv[i] );
+            if ( !args->fps )
+                usage( args->progname );
+        }
         else if( !strcmp(argv[i], "--hud") )
         {
             args->hud = true;
@@ -197,29 +404,115 @@ void parseArgs( int argc, char* argv[], struct arguments* args )
         {
             version();
         }
-        else if( argv[i][0] == '-' )
+        else if( argv[i][0] == '-' && argv[i][1] ) // A lone dash is standard input
         {
             usage( args->progname );
         }
         else
         {
-            if( args->sceneFilename )
-                usage( args->progname );
-            args->sceneFilename = argv[i];
+            args->inputs.push_back( argv[i] );
         }
     }
-    if( !args->sceneFilename )
+    if( args->merge )
+    {
+        if( args->inputs.empty() )
+            usage( args->progname );
+        if( args->traceFilename )
+        {
+            std::cerr << "main: --merge doesn't render anything; it cannot be used with --trace." << std::endl;
+            usage( args->progname );
+        }
+        return; // Nothing else matters
+    }
+    if( 1 < args->inputs.size() && !args->gather )
+        usage( args->progname );
+    if( !args->inputs.empty() )
+        args->sceneFilename = args->inputs[0];
+    args->inputs.erase( args->inputs.begin(), args->inputs.begin() + std::min<size_t>(1, args->inputs.size()) );
+    if( args->gather && args->inputs.empty() )
+    {
+        std::cerr << "main: --gather needs the Framebuffers written by --shard after the scene file." << std::endl;
+        usage( args->progname );
+    }
+    if( 1 < args->shards || args->shardCount || args->gather )
+    {
+        if( (1 < args->shards) + (0 < args->shardCount) + args->gather > 1 )
+        {
+            std::cerr << "main: please specify only one of --shards, --shard and --gather." << std::endl;
+            usage( args->progname );
+        }
+        if( args->splitLevels || args->motionsFilename || args->benchmarkFrames || -1 != args->lastFrame || args->serve )
+        {
+            std::cerr << "main: shards are single images; --split-levels, --motions, --benchmark, --animate and --serve cannot be used with them." << std::endl;
+            usage( args->progname );
+        }
+#ifdef COMPILE_WITH_GUI
+        if( args->gui )
+        {
+            std::cerr << "main: shards cannot be rendered in GUI mode." << std::endl;
+            usage( args->progname );
+        }
+#endif
+        if( 1 < args->shards && args->sceneFilename && !strcmp(args->sceneFilename, "-") )
+        {
+            std::cerr << "main: --shards hands the scene file to each worker and cannot take it from standard input." << std::endl;
+            usage( args->progname );
+        }
+    }
+#ifdef COMPILE_WITH_GUI
+    if( args->gui && args->serve )
+    {
+        std::cerr << "main: warning: starting in GUI mode, disregarding --serve and --listen settings." << std::endl;
+        args->serve = false;
+    }
+    if( args->gui && args->cropWidth )
+    {
+        std::cerr << "main: warning: starting in GUI mode, disregarding --crop setting." << std::endl;
+        args->cropWidth = 0;
+    }
+#endif
+    if( args->serve && args->compileFilename )
+    {
+        std::cerr << "main: --compile cannot be used with the server." << std::endl;
+        usage( args->progname );
+    }
+    if( args->serve && args->cropWidth )
+    {
+        std::cerr << "main: --crop cannot be used with the server." << std::endl;
+        usage( args->progname );
+    }
+    if( args->serve )
+    {
+        if( args->splitLevels || args->motionsFilename || args->benchmarkFrames || -1 != args->lastFrame )
+        {
+            std::cerr << "main: the server renders single images; --split-levels, --motions, --benchmark and --animate cannot be used with it." << std::endl;
+            usage( args->progname );
+        }
+        if( args->sceneFilename && !strcmp(args->sceneFilename, "-") )
+        {
+            std::cerr << "main: the server reads jobs from standard input, it cannot take the scene from there too." << std::endl;
+            usage( args->progname );
+        }
+    }
+    else if( !args->sceneFilename )
         usage( args->progname );
 #ifdef COMPILE_WITH_GUI
     if( args->gui )
     {
         if( strcmp( args->outFilename, "image.ppm" ) )
             std::cerr << "main: warning: starting in GUI mode, disregarding --out setting." << std::endl;
+        if( args->splitLevels )
+            std::cerr << "main: warning: starting in GUI mode, disregarding --split-levels setting." << std::endl;
+        if( args->benchmarkFrames )
+            std::cerr << "main: warning: starting in GUI mode, disregarding --benchmark setting." << std::endl;
+        if( -1 != args->lastFrame )
+            std::cerr << "main: warning: starting in GUI mode, disregarding --animate setting." << std::endl;
+        args->benchmarkFrames = 0;
+        args->dumpFrames      = false;
+        args->lastFrame       = -1;
     }
     else
     {
-        if( args->motionsFilename )
-            std::cerr << "main: warning: starting in CLI mode, disregarding --motions setting." << std::endl;
         if( args->hud )
             std::cerr << "main: warning: starting in CLI mode, disregarding --hud setting." << std::endl;
     }
@@ -230,11 +523,568 @@ void parseArgs( int argc, char* argv[], struct arguments* args )
         std::cerr << "main: (Note that levels start at 0.)" << std::endl;
         usage( args->progname );
     }
+    if( args->splitLevels && -1 != args->level )
+    {
+        std::cerr << "main: --split-levels already writes every --level of the render, please specify only one of them." << std::endl;
+        usage( args->progname );
+    }
+    if( args->splitLevels && !strcmp(args->outFilename, "-") )
+    {
+        std::cerr << "main: --split-levels writes multiple images and cannot be used with standard output." << std::endl;
+        usage( args->progname );
+    }
+    if( args->dumpFrames && !args->benchmarkFrames )
+    {
+        std::cerr << "main: --dump-frames only makes sense with --benchmark." << std::endl;
+        usage( args->progname );
+    }
+    if( args->benchmarkFrames && args->splitLevels )
+    {
+        std::cerr << "main: --split-levels cannot be used with --benchmark." << std::endl;
+        usage( args->progname );
+    }
+    if( args->dumpFrames && !strcmp(args->outFilename, "-") )
+    {
+        std::cerr << "main: --dump-frames writes multiple images and cannot be used with standard output." << std::endl;
+        usage( args->progname );
+    }
+    if( -1 != args->lastFrame )
+    {
+        if( args->benchmarkFrames || args->splitLevels )
+        {
+            std::cerr << "main: --animate cannot be used with --benchmark or --split-levels." << std::endl;
+            usage( args->progname );
+        }
+        if( !strcmp(args->outFilename, "-") )
+        {
+            std::cerr << "main: --animate writes multiple images and cannot be used with standard output." << std::endl;
+            usage( args->progname );
+        }
+        if( !strcmp(args->sceneFilename, "-") || (args->motionsFilename && !strcmp(args->motionsFilename, "-")) )
+        {
+            std::cerr << "main: --animate reads its input files twice and cannot take them from standard input." << std::endl;
+            usage( args->progname );
+        }
+    }
+    if( args->costMap )
+    {
+        if( args->serve || args->benchmarkFrames || -1 != args->lastFrame || 1 < args->shards || args->shardCount || args->gather || args->compileFilename )
+        {
+            std::cerr << "main: --costs maps a single render; it cannot be used with --serve, --benchmark, --animate, --shards, --shard, --gather or --compile." << std::endl;
+            usage( args->progname );
+        }
+        if( !strcmp(args->outFilename, "-") )
+        {
+            std::cerr << "main: --costs writes a second image and cannot be used with standard output." << std::endl;
+            usage( args->progname );
+        }
+#ifdef COMPILE_WITH_GUI
+        if( args->gui )
+            std::cerr << "main: warning: starting in GUI mode, disregarding --costs setting." << std::endl;
+#endif
+    }
+    if( args->statsFilename )
+    {
+        if( args->serve || args->benchmarkFrames || -1 != args->lastFrame || 1 < args->shards || args->shardCount || args->gather || args->compileFilename )
+        {
+            std::cerr << "main: --stats reports on a single render; it cannot be used with --serve, --benchmark, --animate, --shards, --shard, --gather or --compile." << std::endl;
+            usage( args->progname );
+        }
+        if( !strcmp(args->statsFilename, "-") && !strcmp(args->outFilename, "-") )
+        {
+            std::cerr << "main: the image and the --stats report cannot both go to standard output." << std::endl;
+            usage( args->progname );
+        }
+#ifdef COMPILE_WITH_GUI
+        if( args->gui )
+            std::cerr << "main: warning: starting in GUI mode, disregarding --stats setting." << std::endl;
+#endif
+    }
+    if( args->traceFilename )
+    {
+        if( args->serve || 1 < args->shards || args->compileFilename )
+        {
+            std::cerr << "main: --trace records renders in this process; it cannot be used with --serve, --shards or --compile." << std::endl;
+            usage( args->progname );
+        }
+        if( !strcmp(args->traceFilename, "-") && (!strcmp(args->outFilename, "-") || (args->statsFilename && !strcmp(args->statsFilename, "-"))) )
+        {
+            std::cerr << "main: only one of the image, the --stats report and the --trace can go to standard output." << std::endl;
+            usage( args->progname );
+        }
+#ifdef COMPILE_WITH_GUI
+        if( args->gui )
+            std::cerr << "main: warning: starting in GUI mode, disregarding --trace setting." << std::endl;
+#endif
+    }
+    if( !args->benchmarkFrames && -1 == args->lastFrame && args->motionsFilename
+#ifdef COMPILE_WITH_GUI
+        && !args->gui
+#endif
+      )
+        std::cerr << "main: warning: rendering a single image, disregarding --motions setting." << std::endl;
 }
 
 Camera* camera = NULL;
+
+// Insert a suffix before the extension of a filename, e.g. image.ppm -> image_level0.ppm
+std::string suffixFilename( const std::string& filename, const std::string& suffix )
+{
+    const size_t dot   = filename.rfind( '.' );
+    const size_t slash = filename.rfind( '/' );
+    if ( std::string::npos == dot || (std::string::npos != slash && dot < slash) )
+        return filename + suffix;
+    return filename.substr( 0, dot ) + suffix + filename.substr( dot );
+}
+
+std::string levelFilename( const std::string& filename, int level )
+{
+    std::stringstream ss;
+    ss << "_level" << level;
+    return suffixFilename( filename, ss.str() );
+}
+
+std::string frameFilename( const std::string& filename, int frame )
+{
+    std::stringstream ss;
+    ss << "_frame" << std::setw( 4 ) << std::setfill( '0' ) << frame;
+    return suffixFilename( filename, ss.str() );
+}
+
+// The cost map is always a PFM, e.g. image.ppm -> image_costs.pfm
+std::string costsFilename( const std::string& filename )
+{
+    const std::string suffixed = suffixFilename( filename, "_costs" );
+    const size_t dot   = suffixed.rfind( '.' );
+    const size_t slash = suffixed.rfind( '/' );
+    if ( std::string::npos == dot || (std::string::npos != slash && dot < slash) )
+        return suffixed + ".pfm";
+    return suffixed.substr( 0, dot ) + ".pfm";
+}
+
+// Nearest-rank percentile of a sorted sample
+double percentile( const std::vector< double >& sorted, double p )
+{
+    const int rank = std::ceil( p / 100 * sorted.size() );
+    return sorted[ std::max(1, rank) - 1 ];
+}
+
+// Replay the motions offscreen at a fixed time step and report how long the frames took
+void benchmark( const struct arguments& args, const std::vector< Motion* >& motions )
+{
+    const int frames = args.benchmarkFrames;
+    std::vector< double > buildTimes, rasterizeTimes, totalTimes;
+    Renderer renderer( camera->getScene() );
+    renderer.addCamera( camera );
+    for( int frame = 0; frame < frames; ++frame )
+    {
+        if( 0 < frame )
+            for( std::vector< Motion* >::const_iterator m = motions.begin(); m != motions.end(); m++ )
+                (*m)->step( args.dt );
+        // Without any motions the Zones of the last frame would simply be reused
+        renderer.clearZoneForest();
+        renderer.render( 0, args.depth, args.level, args.cutoff, args.gamma );
+        buildTimes    .push_back( renderer.getBuildTime() );
+        rasterizeTimes.push_back( renderer.getRasterizeTime() );
+        totalTimes    .push_back( renderer.getBuildTime() + renderer.getRasterizeTime() );
+        if( modeFlags.verbose )
+            std::cerr << "main: frame " << frame << " took " << 1000 * totalTimes.back() << " ms" << std::endl;
+        if( args.dumpFrames )
+        {
+            Trace::Scope trace( "encode frame" );
+            const std::string filename = frameFilename( args.outFilename, frame );
+            std::ofstream ofs( filename.c_str(), std::ios::binary );
+            if( !ofs.is_open() )
+                die( 4, "cannot write file at '" + filename + "'" );
+            camera->writePixels( ofs, imageFormat(filename) );
+        }
+    }
+
+    std::cout << "Benchmark: " << frames << " frames of '" << args.sceneFilename << "'";
+    if( args.motionsFilename )
+        std::cout << " with motions '" << args.motionsFilename << "'";
+    std::cout << ", dt = " << args.dt << " s" << std::endl;
+    std::cout << "                 p50 ms     p95 ms     p99 ms    mean ms" << std::endl;
+    const char* const     names[3] = { "build    ", "rasterize", "total    " };
+    std::vector< double >* times[3] = { &buildTimes, &rasterizeTimes, &totalTimes };
+    std::cout << std::fixed << std::setprecision( 2 );
+    for( int i = 0; i < 3; ++i )
+    {
+        std::vector< double >& sample = *times[i];
+        std::sort( sample.begin(), sample.end() );
+        double sum = 0;
+        for( std::vector< double >::const_iterator t = sample.begin(); t != sample.end(); t++ )
+            sum += *t;
+        std::cout << "  " << names[i]
+                  << std::setw( 11 ) << 1000 * percentile( sample, 50 )
+                  << std::setw( 11 ) << 1000 * percentile( sample, 95 )
+                  << std::setw( 11 ) << 1000 * percentile( sample, 99 )
+                  << std::setw( 11 ) << 1000 * sum / sample.size() << std::endl;
+    }
+}
+
+// Narrow the Camera down to the --crop rectangle, if any
+void crop( const struct arguments& args, Camera* camera )
+{
+    if( !args.cropWidth )
+        return;
+    if( camera->getGridwidth() < args.cropX + args.cropWidth || camera->getGridheight() < args.cropY + args.cropHeight )
+    {
+        std::ostringstream oss;
+        oss << "the --crop rectangle doesn't fit in the " << camera->getGridwidth() << "x" << camera->getGridheight() << " grid of the Camera";
+        die( 1, oss.str() );
+    }
+    camera->crop( args.cropX, args.cropY, args.cropWidth, args.cropHeight );
+}
+
+// Add up the Framebuffers written by --shard and resolve the final image
+void gatherShards( const std::vector< std::string >& filenames, double gamma )
+{
+    camera->clear();
+    for( std::vector< std::string >::const_iterator f = filenames.begin(); f != filenames.end(); f++ )
+    {
+        std::ifstream ifs( f->c_str(), std::ios::binary );
+        if( !ifs.is_open() )
+            throw "cannot read file at '" + *f + "'";
+        try {
+            camera->addFramebuffer( ifs );
+        }
+        catch( const std::string& e ) {
+            throw *f + ": " + e;
+        }
+    }
+    camera->resolve( gamma );
+    if( modeFlags.verbose )
+        std::cerr << "main: added up the Framebuffers of " << filenames.size() << " shards." << std::endl;
+}
+
+// Start a copy of this program for each shard, each writing its Framebuffer to a temporary file,
+// and add up the results once they're all done
+void renderShards( const struct arguments& args )
+{
+    const char* tmpdir = getenv( "TMPDIR" );
+    const std::string prefix = std::string( tmpdir && *tmpdir ? tmpdir : "/tmp" ) + "/silence-shardXXXXXX";
+    std::vector< std::string > filenames;
+    std::vector< pid_t >       workers;
+    // Share the cores among the workers instead of giving each of them all of them
+    const int cores = std::max( 1u, std::thread::hardware_concurrency() );
+    for( int i = 0; i < args.shards; ++i )
+    {
+        std::vector< char > name( prefix.begin(), prefix.end() );
+        name.push_back( '\0' );
+        const int fd = mkstemp( &name[0] );
+        if( -1 == fd )
+            die( 4, "cannot create a temporary file at '" + prefix + "'" );
+        close( fd );
+        filenames.push_back( &name[0] );
+
+        std::vector< std::string > workerArgs;
+        std::ostringstream oss;
+        workerArgs.push_back( args.progname );
+        workerArgs.push_back( args.sceneFilename );
+        oss.str( "" ); oss << args.depth;  workerArgs.push_back( "-d" ); workerArgs.push_back( oss.str() );
+        if( -1 != args.level )
+        {
+            oss.str( "" ); oss << args.level; workerArgs.push_back( "-l" ); workerArgs.push_back( oss.str() );
+        }
+        oss.str( "" ); oss << std::setprecision( 17 ) << args.cutoff; workerArgs.push_back( "-c" ); workerArgs.push_back( oss.str() );
+        if( args.cropWidth )
+        {
+            oss.str( "" ); oss << args.cropX << "," << args.cropY << "," << args.cropWidth << "," << args.cropHeight;
+            workerArgs.push_back( "--crop" ); workerArgs.push_back( oss.str() );
+        }
+        oss.str( "" ); oss << i << "/" << args.shards; workerArgs.push_back( "--shard" ); workerArgs.push_back( oss.str() );
+        workerArgs.push_back( "-o" ); workerArgs.push_back( filenames.back() );
+        if( modeFlags.verbose )
+            workerArgs.push_back( "-v" );
+        oss.str( "" ); oss << std::max( 1, cores / args.shards + (i < cores % args.shards) );
+        const std::string threads = oss.str();
+
+        const pid_t pid = fork();
+        if( -1 == pid )
+            die( 4, "cannot start a worker process" );
+        if( 0 == pid )
+        {
+            std::vector< char* > argv;
+            for( std::vector< std::string >::iterator a = workerArgs.begin(); a != workerArgs.end(); a++ )
+                argv.push_back( &(*a)[0] );
+            argv.push_back( NULL );
+            setenv( "OMP_NUM_THREADS", threads.c_str(), 1 );
+            execvp( argv[0], &argv[0] );
+            std::cerr << "main: cannot run '" << argv[0] << "'" << std::endl;
+            _exit( 127 );
+        }
+        workers.push_back( pid );
+        if( modeFlags.verbose )
+            std::cerr << "main: shard " << i << " of " << args.shards << " started as process " << pid << " with " << threads << " thread(s)" << std::endl;
+    }
+
+    bool failed = false;
+    for( int i = 0; i < args.shards; ++i )
+    {
+        int status;
+        if( -1 == waitpid( workers[i], &status, 0 ) || !WIFEXITED(status) || WEXITSTATUS(status) )
+        {
+            std::cerr << "main: shard " << i << " of " << args.shards << " failed." << std::endl;
+            failed = true;
+        }
+    }
+    std::string error;
+    if( !failed )
+    {
+        try {
+            gatherShards( filenames, args.gamma );
+        }
+        catch( const std::string& e ) {
+            error = e;
+        }
+    }
+    for( int i = 0; i < args.shards; ++i )
+        unlink( filenames[i].c_str() );
+    if( failed )
+        die( 4, "not all shards could be rendered" );
+    if( !error.empty() )
+        die( 3, error );
+}
+
+// Put together tiles rendered with --crop. The full image is just big enough to hold all of them
+void merge( const struct arguments& args )
+{
+    struct Tile {
+        std::vector< float > pixels;
+        int x, y, width, height;
+    };
+    std::vector< Tile > tiles( args.inputs.size() );
+    int width = 0, height = 0;
+    for( size_t i = 0; i < tiles.size(); ++i )
+    {
+        const std::string spec = args.inputs[i];
+        const size_t at = spec.rfind( '@' );
+        if( std::string::npos == at || 2 != sscanf( spec.c_str() + at + 1, "%d,%d", &tiles[i].x, &tiles[i].y ) || tiles[i].x < 0 || tiles[i].y < 0 )
+        {
+            std::cerr << "main: tiles must be given as TILE_FILENAME@X,Y, '" << spec << "' is not." << std::endl;
+            usage( args.progname );
+        }
+        const std::string filename = spec.substr( 0, at );
+        std::ifstream ifs( filename.c_str(), std::ios::binary );
+        if( !ifs.is_open() )
+            die( 2, "cannot read file at '" + filename + "'" );
+        try {
+            readImage( ifs, tiles[i].pixels, tiles[i].width, tiles[i].height );
+        }
+        catch( const std::string& e ) {
+            die( 3, filename + ": " + e );
+        }
+        width  = std::max( width,  tiles[i].x + tiles[i].width  );
+        height = std::max( height, tiles[i].y + tiles[i].height );
+    }
+
+    std::vector< float > image( 3 * (size_t)width * height, 0.0f );
+    long covered = 0;
+    for( std::vector< Tile >::const_iterator tile = tiles.begin(); tile != tiles.end(); tile++ )
+    {
+        for( int row = 0; row < tile->height; ++row )
+            std::copy( tile->pixels.begin() + 3 * tile->width * row, tile->pixels.begin() + 3 * tile->width * (row + 1),
+                       image.begin() + 3 * ((size_t)width * (tile->y + row) + tile->x) );
+        covered += (long)tile->width * tile->height;
+    }
+    if( covered != (long)width * height )
+        std::cerr << "main: warning: the tiles don't cover the " << width << "x" << height << " image exactly once." << std::endl;
+    if( modeFlags.verbose )
+        std::cerr << "main: merged " << tiles.size() << " tiles into a " << width << "x" << height << " image." << std::endl;
+
+    if( !strcmp(args.outFilename, "-") )
+    {
+        writeImage( std::cout, IMAGE_PPM, &image[0], width, height, width );
+        return;
+    }
+    std::ofstream ofs( args.outFilename, std::ios::binary );
+    if( !ofs.is_open() )
+        die( 4, "cannot write file at '" + std::string(args.outFilename) + "'" );
+    writeImage( ofs, imageFormat(args.outFilename), &image[0], width, height, width );
+}
+
+// An independent copy of the Scene with its own Motions, Camera and Renderer
+struct AnimationSlot {
+    AnimationSlot( Camera* camera, const std::vector< Motion* >& motions )
+        : camera( camera )
+        , motions( motions )
+        , renderer( camera->getScene() )
+    {
+        renderer.addCamera( camera );
+    }
+    ~AnimationSlot()
+    {
+        for( std::vector< Motion* >::iterator m = motions.begin(); m != motions.end(); m++ )
+            delete *m;
+        delete camera->getScene();
+        delete camera;
+    }
+
+    // Step the Motions forward by a number of frames
+    void advance( int frames, double dt )
+    {
+        for( int i = 0; i < frames; ++i )
+            for( std::vector< Motion* >::iterator m = motions.begin(); m != motions.end(); m++ )
+                (*m)->step( dt );
+    }
+
+    Camera*                camera;
+    std::vector< Motion* > motions;
+    Renderer               renderer;
+    std::future< void >    written; // The last image this slot's Camera is being encoded into
+};
+
+void writeFrame( const Camera* camera, const std::string& filename )
+{
+    Trace::Scope trace( "encode frame" );
+    std::ofstream ofs( filename.c_str(), std::ios::binary );
+    if( !ofs.is_open() )
+        die( 4, "cannot write file at '" + filename + "'" );
+    camera->writePixels( ofs, imageFormat(filename) );
+}
+
+// Render a range of frames to numbered images. Two copies of the Scene take turns so the
+// next frame's Zones can be built while the current one is rasterized and the one before
+// is being encoded
+void animate( const struct arguments& args, const std::vector< Motion* >& motions )
+{
+    Camera* secondCamera = NULL;
+    try {
+        secondCamera = parseSceneFile( args.sceneFilename );
+    }
+    catch( const std::string& e ) {
+        die( 3, e );
+    }
+    if( !secondCamera )
+        die( 2, "cannot read file at '" + std::string(args.sceneFilename) + "'" );
+    crop( args, secondCamera );
+    std::vector< Motion* > secondMotions;
+    if( args.motionsFilename )
+    {
+        std::ifstream motionsFile( args.motionsFilename );
+        try {
+            secondMotions = parseMotions( motionsFile, secondCamera->getScene() );
+        }
+        catch( const std::string& e ) {
+            die( 3, e );
+        }
+    }
+    AnimationSlot first( camera, motions );
+    AnimationSlot second( secondCamera, secondMotions );
+    AnimationSlot* slots[2] = { &first, &second };
+    camera = NULL; // The slots own it now
+
+    // Get both copies of the Scene to their first frames
+    const int firstFrame = args.firstFrame;
+    const int lastFrame  = args.lastFrame;
+    slots[ firstFrame % 2 ]      ->advance( firstFrame,     args.dt );
+    slots[ (firstFrame + 1) % 2 ]->advance( firstFrame + 1, args.dt );
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::future< bool > built = std::async( std::launch::async, &Renderer::build, &slots[firstFrame % 2]->renderer,
+                                            0, args.depth, args.level, args.cutoff );
+    for( int frame = firstFrame; frame <= lastFrame; ++frame )
+    {
+        AnimationSlot* current = slots[ frame % 2 ];
+        AnimationSlot* next    = slots[ (frame + 1) % 2 ];
+        built.get();
+        if( frame < lastFrame )
+        {
+            // The next frame's Scene was left two frames behind
+            if( firstFrame < frame )
+                next->advance( 2, args.dt );
+            built = std::async( std::launch::async, &Renderer::build, &next->renderer,
+                                0, args.depth, args.level, args.cutoff );
+        }
+        if( current->written.valid() )
+            current->written.get(); // The Camera is needed again
+        current->renderer.rasterize( 0, args.level, args.gamma );
+        current->written = std::async( std::launch::async, &writeFrame, current->camera, frameFilename(args.outFilename, frame) );
+        if( modeFlags.verbose )
+            std::cerr << "main: frame " << frame << " rasterized in " << current->renderer.getRasterizeTime() << " s, Zones built in "
+                      << current->renderer.getBuildTime() << " s" << std::endl;
+    }
+    for( int i = 0; i < 2; ++i )
+        if( slots[i]->written.valid() )
+            slots[i]->written.get();
+    if( modeFlags.verbose )
+    {
+        const double elapsed = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+        std::cerr << "main: " << lastFrame - firstFrame + 1 << " frames written in " << elapsed << " s" << std::endl;
+    }
+}
+
+// Write the loaded scene in compiled form
+void compile( const struct arguments& args )
+{
+    std::ofstream ofs;
+    if( strcmp(args.compileFilename, "-") )
+    {
+        ofs.open( args.compileFilename, std::ios::binary );
+        if( !ofs.is_open() )
+            die( 4, "cannot write file at '" + std::string(args.compileFilename) + "'" );
+    }
+    std::ostream& os = ofs.is_open() ? ofs : std::cout;
+    try {
+        compileScene( os, *camera );
+    }
+    catch( const std::string& e ) {
+        die( 3, e );
+    }
+    if( !os.flush() )
+        die( 4, "cannot write file at '" + std::string(args.compileFilename) + "'" );
+    if( modeFlags.verbose )
+        std::cerr << "main: compiled scene written to '" << args.compileFilename << "'" << std::endl;
+}
+
+// Keep rendering jobs until the input runs out
+void serve( const struct arguments& args )
+{
+    Job defaults;
+    if( args.sceneFilename )
+        defaults.sceneFilename = args.sceneFilename;
+    defaults.depth  = args.depth;
+    defaults.level  = args.level;
+    defaults.cutoff = args.cutoff;
+    defaults.gamma  = args.gamma;
+    Server server( defaults, args.workers, args.cacheSize );
+    if( args.socketFilename )
+    {
+        try {
+            server.listen( args.socketFilename );
+        }
+        catch( const std::string& e ) {
+            die( 2, e );
+        }
+    }
+    else
+        server.serve( std::cin, std::cout );
+}
+
+// Write out the --trace recording, if any. All rendering threads must be done by now
+void writeTrace( const struct arguments& args )
+{
+    if( !Trace::isEnabled() )
+        return;
+    Trace::enable( false );
+    if( !strcmp(args.traceFilename, "-") )
+        Trace::writeJson( std::cout );
+    else
+    {
+        std::ofstream ofs( args.traceFilename );
+        if( !ofs.is_open() )
+            die( 4, "cannot write file at '" + std::string(args.traceFilename) + "'" );
+        Trace::writeJson( ofs );
+    }
+    if( modeFlags.verbose )
+        std::cerr << "main: trace written to '" << args.traceFilename << "'" << std::endl;
+}
+
 void cleanup()
 {
+    if( !camera )
+        return;
     delete camera->getScene();
     delete camera;
 }
@@ -248,17 +1098,60 @@ int main( int argc, char* argv[] )
     struct arguments args;
     args.depth           =  6;
     args.level           = -1;
+    args.splitLevels     = false;
+    args.costMap         = false;
     args.cutoff          =  0;
     args.gamma           =  1;
     args.sceneFilename   = NULL;
     args.outFilename     = (char*)"image.ppm";
+    args.compileFilename = NULL;
+    args.motionsFilename = NULL;
+    args.statsFilename   = NULL;
+    args.traceFilename   = NULL;
+    args.benchmarkFrames =  0;
+    args.firstFrame      =  0;
+    args.lastFrame       = -1;
+    args.dt              =  0.1;
+    args.seed            =  0;
+    args.seeded          = false;
+    args.dumpFrames      = false;
+    args.serve           = false;
+    args.socketFilename  = NULL;
+    args.workers         = std::max( 1u, std::thread::hardware_concurrency() );
+    args.cacheSize       =  8;
+    args.cropX           =  0;
+    args.cropY           =  0;
+    args.cropWidth       =  0;
+    args.cropHeight      =  0;
+    args.merge           = false;
+    args.shardIndex      =  0;
+    args.shardCount      =  0;
+    args.shards          =  1;
+    args.gather          = false;
 #ifdef COMPILE_WITH_GUI
     args.gui             = false;
     args.fps             = 10;
-    args.motionsFilename = NULL;
     args.hud             = false;
 #endif
     parseArgs( argc, argv, &args );
+    if( !args.seeded )
+        args.seed = std::time( NULL );
+    Random::setSeed( args.seed );
+    Stats::enable( args.statsFilename
+#ifdef COMPILE_WITH_GUI
+                   && !args.gui
+#endif
+                 );
+    Trace::enable( args.traceFilename
+#ifdef COMPILE_WITH_GUI
+                   && !args.gui
+#endif
+                 );
+    if( args.merge )
+    {
+        merge( args );
+        return 0;
+    }
     if( modeFlags.verbose )
     {
         std::cerr << "main: arguments: ";
@@ -267,9 +1160,16 @@ int main( int argc, char* argv[] )
         if( !args.gui )
 #endif
             std::cerr << ", outFilename = " << args.outFilename;
+        std::cerr << ", seed = " << args.seed;
         std::cerr << std::endl;
     }
 
+    if( args.serve )
+    {
+        serve( args );
+        return 0;
+    }
+
     // Process scene description input
     if( modeFlags.verbose )
     {
@@ -278,31 +1178,29 @@ int main( int argc, char* argv[] )
         else
             std::cerr << "main: reading scene file '" << args.sceneFilename << "'..." << std::endl;
     }
-    std::istream* is;
-    std::ifstream ifs;
-    if( !strcmp(args.sceneFilename, "-") )
-    {
-        is = &std::cin;
-    }
-    else
-    {
-        ifs.open( args.sceneFilename );
-        if( !ifs.is_open() )
-            die( 2, "cannot read file at '" + std::string(args.sceneFilename) + "'" );
-        is = &ifs;
-    }
     try {
-        camera = parseScene( *is );
+        Stats::Timer timer( "parse" );
+        Trace::Scope trace( "parse" );
+        if( !strcmp(args.sceneFilename, "-") )
+            camera = parseScene( std::cin );
+        else
+            camera = parseSceneFile( args.sceneFilename );
     }
     catch( const std::string& e ) {
         die( 3, e );
     }
-    if( ifs.is_open() )
-        ifs.close();
+    if( !camera )
+        die( 2, "cannot read file at '" + std::string(args.sceneFilename) + "'" );
     if( modeFlags.verbose )
         std::cerr << "main: input scene file read successfully." << std::endl;
+    if( args.compileFilename )
+    {
+        compile( args );
+        cleanup();
+        return 0;
+    }
+    crop( args, camera );
 
-#ifdef COMPILE_WITH_GUI
     std::vector< Motion* > motions;
     if( args.motionsFilename )
     {
@@ -314,6 +1212,8 @@ int main( int argc, char* argv[] )
             else
                 std::cerr << "main: reading motions file '" << args.motionsFilename << "'..." << std::endl;
         }
+        std::istream* is;
+        std::ifstream ifs;
         if( !strcmp(args.motionsFilename, "-") )
         {
             is = &std::cin;
@@ -337,6 +1237,7 @@ int main( int argc, char* argv[] )
             std::cerr << "main: input motions file read successfully." << std::endl;
     }
 
+#ifdef COMPILE_WITH_GUI
     if ( args.gui )
     {
         if ( modeFlags.verbose )
@@ -351,6 +1252,21 @@ int main( int argc, char* argv[] )
     }
 #endif
 
+    if( args.benchmarkFrames || -1 != args.lastFrame )
+    {
+        if( args.benchmarkFrames )
+        {
+            benchmark( args, motions );
+            for( std::vector< Motion* >::iterator m = motions.begin(); m != motions.end(); m++ )
+                delete *m;
+        }
+        else
+            animate( args, motions ); // Takes ownership of the motions
+        writeTrace( args );
+        cleanup();
+        return 0;
+    }
+
     if( strcmp(args.outFilename, "-") )
     {
         // Check if target file is writable before starting calculations
@@ -369,10 +1285,29 @@ int main( int argc, char* argv[] )
     if ( modeFlags.verbose )
         std::cerr << "main: starting the renderer." << std::endl;
     const time_t start = std::time( NULL );
-    std::srand( start );
+    if( args.splitLevels )
+        camera->setLevelCount( args.depth );
+    if( args.costMap )
+        camera->setCostMap( true );
     Renderer renderer( camera->getScene() );
     renderer.addCamera( camera );
-    renderer.render( 0, args.depth, args.level, args.cutoff, args.gamma );
+    if( args.gather )
+    {
+        try {
+            gatherShards( std::vector< std::string >(args.inputs.begin(), args.inputs.end()), args.gamma );
+        }
+        catch( const std::string& e ) {
+            die( 3, e );
+        }
+    }
+    else if( 1 < args.shards )
+        renderShards( args );
+    else
+    {
+        if( args.shardCount )
+            renderer.setShard( args.shardIndex, args.shardCount );
+        renderer.render( 0, args.depth, args.level, args.cutoff, args.gamma );
+    }
     if ( modeFlags.verbose )
     {
         const time_t end = std::time( NULL );
@@ -386,27 +1321,76 @@ int main( int argc, char* argv[] )
     if( strcmp(args.outFilename, "-") )
     {
         // Dump results into file
+        Stats::Timer timer( "write" );
+        Trace::Scope trace( "encode image" );
+        const ImageFormat format = imageFormat( args.outFilename );
         std::ofstream ofs;
-        ofs.open( args.outFilename );
+        ofs.open( args.outFilename, std::ios::binary );
         while( !ofs.is_open() )
         {
             std::cerr << "cannot write file at '" << args.outFilename << "'; please make the file writable and press Return." << std::endl;
             std::cin.ignore();
-            ofs.open( args.outFilename );
+            ofs.open( args.outFilename, std::ios::binary );
         }
-        camera->writePixels( ofs );
+        if( args.shardCount )
+            camera->writeFramebuffer( ofs );
+        else
+            camera->writePixels( ofs, format );
         ofs.close();
         if ( modeFlags.verbose )
             std::cerr << "main: image written to '" << args.outFilename << "'" << std::endl;
+        for( int level = 0; level < camera->getLevelCount(); ++level )
+        {
+            const std::string filename = levelFilename( args.outFilename, level );
+            ofs.open( filename.c_str(), std::ios::binary );
+            if( !ofs.is_open() )
+                die( 4, "cannot write file at '" + filename + "'" );
+            camera->writePixels( ofs, format, level );
+            ofs.close();
+            if ( modeFlags.verbose )
+                std::cerr << "main: level " << level << " image written to '" << filename << "'" << std::endl;
+        }
+        if( camera->hasCostMap() )
+        {
+            const std::string filename = costsFilename( args.outFilename );
+            ofs.open( filename.c_str(), std::ios::binary );
+            if( !ofs.is_open() )
+                die( 4, "cannot write file at '" + filename + "'" );
+            camera->writeCostMap( ofs );
+            ofs.close();
+            if ( modeFlags.verbose )
+                std::cerr << "main: cost map written to '" << filename << "'" << std::endl;
+        }
     }
     else
     {
         // Dump results to standard output
-        camera->writePixels( std::cout );
+        Stats::Timer timer( "write" );
+        Trace::Scope trace( "encode image" );
+        if( args.shardCount )
+            camera->writeFramebuffer( std::cout );
+        else
+            camera->writePixels( std::cout, IMAGE_PPM );
         if ( modeFlags.verbose )
             std::cerr << "main: image written to standard output" << std::endl;
     }
 
+    if( Stats::isEnabled() )
+    {
+        if( !strcmp(args.statsFilename, "-") )
+            Stats::writeJson( std::cout, args.sceneFilename );
+        else
+        {
+            std::ofstream ofs( args.statsFilename );
+            if( !ofs.is_open() )
+                die( 4, "cannot write file at '" + std::string(args.statsFilename) + "'" );
+            Stats::writeJson( ofs, args.sceneFilename );
+        }
+        if ( modeFlags.verbose )
+            std::cerr << "main: stats written to '" << args.statsFilename << "'" << std::endl;
+    }
+    writeTrace( args );
+
     cleanup();
     return 0;
 }
@@ -0,0 +1,631 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A compact binary form of scene descriptions that loads without any parsing
+// The file is a header followed by flat arrays of fixed size records, each one a multiple of 8 bytes
+// long, in the byte order of the machine that wrote it:
+//   header, globals (Camera and Sky), Lights, Things, Materials, points, spheres, planes, triangles, meshes,
+//   then the vertices and the (padded) vertex indices of each mesh in turn
+// Parts refer to their Object by index (Lights first, then Things) and to their place in it by slot.
+// A mesh takes up one slot for each of its faces, starting with the one it refers to. Meshes that share
+// their faces with an earlier one (instances of it) refer to that one instead of storing vertex indices
+// Part of Silence, an experimental rendering engine
+
+#include "compiledscene.h"
+
+#include <cstring>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../core/camera.h"
+#include "../core/material.h"
+#include "../core/scene.h"
+
+namespace Silence {
+
+    static const char     magic[8]  = { 'S', 'I', 'L', 'E', 'N', 'C', 'E', '\x1a' };
+    static const uint32_t version   = 3;
+    static const uint32_t noMesh    = 0xffffffff;
+    static const uint32_t byteOrder = 0x01020304;
+
+    struct FileHeader {
+        char     magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t lightCount;
+        uint32_t thingCount;
+        uint32_t materialCount;
+        uint32_t pointCount;
+        uint32_t sphereCount;
+        uint32_t planeCount;
+        uint32_t triangleCount;
+        uint32_t meshCount;
+    };
+
+    struct GlobalsRecord {
+        double  sky[3];
+        double  viewpoint[3];
+        double  window[4][3];
+        int32_t gridwidth;
+        int32_t gridheight;
+    };
+
+    struct LightRecord {
+        double   emission[3];
+        uint32_t partCount;
+        uint8_t  background;
+        uint8_t  backCulled;
+        uint8_t  reserved[2];
+    };
+
+    struct ThingRecord {
+        uint32_t material;
+        uint32_t partCount;
+        uint8_t  background;
+        uint8_t  backCulled;
+        uint8_t  reserved[6];
+    };
+
+    struct MaterialRecord {
+        double character[4]; // Diffuse, metallic, reflecting, refractive
+        double color[3];
+        double refractiveIndex;
+    };
+
+    struct PartRecord {
+        uint32_t object;
+        uint32_t slot;
+    };
+
+    struct PointRecord    : PartRecord { double point[3]; };
+    struct SphereRecord   : PartRecord { double center[3]; double radius; };
+    struct PlaneRecord    : PartRecord { double normal[3]; double offset; };
+    struct TriangleRecord : PartRecord { double points[3][3]; };
+    struct MeshRecord     : PartRecord { uint32_t vertexCount; uint32_t faceCount; uint32_t topology; uint32_t reserved; }; // 'topology' is an earlier mesh or noMesh
+
+    static_assert( 48  == sizeof(FileHeader),     "FileHeader is padded" );
+    static_assert( 152 == sizeof(GlobalsRecord),  "GlobalsRecord is padded" );
+    static_assert( 32  == sizeof(LightRecord),    "LightRecord is padded" );
+    static_assert( 16  == sizeof(ThingRecord),    "ThingRecord is padded" );
+    static_assert( 64  == sizeof(MaterialRecord), "MaterialRecord is padded" );
+    static_assert( 32  == sizeof(PointRecord),    "PointRecord is padded" );
+    static_assert( 40  == sizeof(SphereRecord),   "SphereRecord is padded" );
+    static_assert( 40  == sizeof(PlaneRecord),    "PlaneRecord is padded" );
+    static_assert( 80  == sizeof(TriangleRecord), "TriangleRecord is padded" );
+    static_assert( 24  == sizeof(MeshRecord),     "MeshRecord is padded" );
+
+    // Bytes taken up by the vertices and indices of a mesh
+    static uint64_t meshDataSize( const MeshRecord& record )
+    {
+        const uint64_t indexSize = noMesh == record.topology ? (uint64_t)record.faceCount * 3 * sizeof(uint32_t) : 0;
+        return (uint64_t)record.vertexCount * 3 * sizeof(double) + (indexSize + 7) / 8 * 8;
+    }
+
+    static void store( double* out, const Triplet& triplet )
+    {
+        out[0] = triplet.x;
+        out[1] = triplet.y;
+        out[2] = triplet.z;
+    }
+
+    static Vector load( const double* in )
+    {
+        return Vector( in[0], in[1], in[2] );
+    }
+
+    template< class T >
+    static void writeRecords( std::ostream& os, const std::vector< T >& records )
+    {
+        if ( !records.empty() )
+            os.write( (const char*)&records[0], records.size() * sizeof(T) );
+    }
+
+    void compileScene( std::ostream& os, const Camera& camera )
+    {
+        const Scene* const scene = camera.getScene();
+        FileHeader header;
+        memset( &header, 0, sizeof(header) );
+        memcpy( header.magic, magic, sizeof(magic) );
+        header.version   = version;
+        header.byteOrder = byteOrder;
+
+        GlobalsRecord globals;
+        memset( &globals, 0, sizeof(globals) );
+        store( globals.sky,       scene->getSky().color );
+        store( globals.viewpoint, camera.getViewpoint() );
+        for ( int i = 0; i < 4; ++i )
+            store( globals.window[i], camera.getCorner(i) );
+        globals.gridwidth  = camera.getGridwidth();
+        globals.gridheight = camera.getGridheight();
+
+        std::vector< LightRecord >    lights;
+        std::vector< ThingRecord >    things;
+        std::vector< MaterialRecord > materials;
+        std::vector< PointRecord >    points;
+        std::vector< SphereRecord >   spheres;
+        std::vector< PlaneRecord >    planes;
+        std::vector< TriangleRecord > triangles;
+        std::vector< MeshRecord >     meshes;
+        std::vector< const Mesh* >    meshData;
+        std::map< std::string, uint32_t > materialIndex; // Identical Materials are only stored once
+
+        uint32_t object = 0;
+        for ( LightIt light = scene->lightsBegin(); light != scene->lightsEnd(); light++, object++ )
+        {
+            LightRecord record;
+            memset( &record, 0, sizeof(record) );
+            store( record.emission, (*light)->getEmission() );
+            record.background = (*light)->isBackground();
+            record.backCulled = (*light)->isBackCulled();
+            for ( LightPartIt part = (*light)->partsBegin(); part != (*light)->partsEnd(); part++, record.partCount++ )
+            {
+                if      ( const LightPoint* point = dynamic_cast< const LightPoint* >( *part ) )
+                {
+                    PointRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    store( out.point, point->getPoint() );
+                    points.push_back( out );
+                }
+                else if ( const LightSphere* sphere = dynamic_cast< const LightSphere* >( *part ) )
+                {
+                    SphereRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    store( out.center, sphere->getCenter() );
+                    out.radius = sphere->getRadius();
+                    spheres.push_back( out );
+                }
+                else if ( const LightPlane* plane = dynamic_cast< const LightPlane* >( *part ) )
+                {
+                    PlaneRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    store( out.normal, plane->getNormal() );
+                    out.offset = plane->getOffset();
+                    planes.push_back( out );
+                }
+                else if ( const LightTriangle* triangle = dynamic_cast< const LightTriangle* >( *part ) )
+                {
+                    TriangleRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    for ( int i = 0; i < 3; ++i )
+                        store( out.points[i], triangle->getVertex(i) );
+                    triangles.push_back( out );
+                }
+                else
+                    throw std::string( "cannot compile this kind of light part" );
+            }
+            lights.push_back( record );
+        }
+        for ( ThingIt thing = scene->thingsBegin(); thing != scene->thingsEnd(); thing++, object++ )
+        {
+            MaterialRecord material;
+            material.character[0]    = (*thing)->interact( Material::DIFFUSE  );
+            material.character[1]    = (*thing)->interact( Material::METALLIC );
+            material.character[2]    = (*thing)->interact( Material::REFLECT  );
+            material.character[3]    = (*thing)->interact( Material::REFRACT  );
+            store( material.color, (*thing)->getColor() );
+            material.refractiveIndex = (*thing)->getRefractiveIndex();
+            const std::string key( (const char*)&material, sizeof(material) );
+            if ( !materialIndex.count(key) )
+            {
+                materialIndex[key] = materials.size();
+                materials.push_back( material );
+            }
+
+            ThingRecord record;
+            memset( &record, 0, sizeof(record) );
+            record.material   = materialIndex[key];
+            record.background = (*thing)->isBackground();
+            record.backCulled = (*thing)->isBackCulled();
+            for ( ThingPartIt part = (*thing)->partsBegin(); part != (*thing)->partsEnd(); part++, record.partCount++ )
+            {
+                if      ( const Sphere* sphere = dynamic_cast< const Sphere* >( *part ) )
+                {
+                    SphereRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    store( out.center, sphere->getCenter() );
+                    out.radius = sphere->getRadius();
+                    spheres.push_back( out );
+                }
+                else if ( const Plane* plane = dynamic_cast< const Plane* >( *part ) )
+                {
+                    PlaneRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    store( out.normal, plane->getNormal() );
+                    out.offset = plane->getOffset();
+                    planes.push_back( out );
+                }
+                else if ( const Triangle* triangle = dynamic_cast< const Triangle* >( *part ) )
+                {
+                    TriangleRecord out;
+                    out.object = object;
+                    out.slot   = record.partCount;
+                    for ( int i = 0; i < 3; ++i )
+                        store( out.points[i], triangle->getVertex(i) );
+                    triangles.push_back( out );
+                }
+                else if ( const MeshTriangle* face = dynamic_cast< const MeshTriangle* >( *part ) )
+                {
+                    if ( 0 != face->getFace() )
+                        continue; // The whole Mesh is stored at its first face
+                    MeshRecord out;
+                    out.object      = object;
+                    out.slot        = record.partCount;
+                    out.vertexCount = face->getMesh()->getVertexCount();
+                    out.faceCount   = face->getMesh()->getFaceCount();
+                    out.topology    = noMesh;
+                    out.reserved    = 0;
+                    for ( uint32_t i = 0; i < meshData.size() && noMesh == out.topology; ++i )
+                        if ( meshData[i]->sharesFaces( *face->getMesh() ) )
+                            out.topology = i;
+                    meshes.push_back( out );
+                    meshData.push_back( face->getMesh() );
+                }
+                else
+                    throw std::string( "cannot compile this kind of thing part" );
+            }
+            things.push_back( record );
+        }
+
+        header.lightCount    = lights.size();
+        header.thingCount    = things.size();
+        header.materialCount = materials.size();
+        header.pointCount    = points.size();
+        header.sphereCount   = spheres.size();
+        header.planeCount    = planes.size();
+        header.triangleCount = triangles.size();
+        header.meshCount     = meshes.size();
+        os.write( (const char*)&header,  sizeof(header) );
+        os.write( (const char*)&globals, sizeof(globals) );
+        writeRecords( os, lights );
+        writeRecords( os, things );
+        writeRecords( os, materials );
+        writeRecords( os, points );
+        writeRecords( os, spheres );
+        writeRecords( os, planes );
+        writeRecords( os, triangles );
+        writeRecords( os, meshes );
+        for ( size_t m = 0; m < meshData.size(); ++m )
+        {
+            const Mesh* const mesh = meshData[m];
+            std::vector< double > vertices( 3 * mesh->getVertexCount() );
+            for ( unsigned int i = 0; i < mesh->getVertexCount(); ++i )
+                store( &vertices[3 * i], mesh->getVertex(i) );
+            writeRecords( os, vertices );
+            if ( noMesh != meshes[m].topology )
+                continue;
+            std::vector< uint32_t > indices( (mesh->getFaceCount() * 3 + 1) / 2 * 2, 0 );
+            for ( unsigned int face = 0; face < mesh->getFaceCount(); ++face )
+                for ( int i = 0; i < 3; ++i )
+                    indices[3 * face + i] = mesh->getIndex( face, i );
+            writeRecords( os, indices );
+        }
+    }
+
+    bool isCompiledScene( const char* data, size_t size )
+    {
+        return sizeof(magic) <= size && !memcmp( data, magic, sizeof(magic) );
+    }
+
+    // Reads records one after the other. They are copied out one at a time since
+    // the data may not be aligned (it usually is, when it's mapped from a file)
+    class RecordReader {
+    public:
+        RecordReader( const char* data ) : pos( data ) { }
+
+        template< class T >
+        T next()
+        {
+            T record;
+            memcpy( &record, pos, sizeof(T) );
+            pos += sizeof(T);
+            return record;
+        }
+
+    private:
+        const char* pos;
+    };
+
+    // Put loaded parts in their places. Each place has to be taken exactly once
+    template< class Part >
+    class PartSlots {
+    public:
+        PartSlots( size_t objectCount ) : first( objectCount + 1, 0 ) { }
+        ~PartSlots()
+        {
+            // Only left over if loading failed
+            for ( size_t i = 0; i < parts.size(); ++i )
+                if ( !borrowed[i] )
+                    delete parts[i];
+        }
+
+        void     setCount( size_t object, uint32_t count ) { first[object + 1] = first[object] + count; }
+        uint32_t getCount( size_t object ) const           { return first[object + 1] - first[object]; }
+        void     allocate() { parts.resize( first.back(), NULL ); borrowed.resize( first.back(), false ); }
+
+        // Fill a place with a part that belongs to someone else, like the face of a Mesh
+        void borrow( size_t object, uint32_t slot, Part* part )
+        {
+            at( object, slot ) = part;
+            borrowed[ first[object] + slot ] = true;
+        }
+
+        Part*& at( size_t object, uint32_t slot )
+        {
+            if ( first.size() - 1 <= object || getCount(object) <= slot )
+                throw std::string( "the compiled scene refers to a part that doesn't exist" );
+            Part*& part = parts[ first[object] + slot ];
+            if ( part )
+                throw std::string( "the compiled scene has two parts in the same place" );
+            return part;
+        }
+        Part* take( size_t object, uint32_t slot )
+        {
+            Part* part = parts[ first[object] + slot ];
+            if ( !part )
+                throw std::string( "the compiled scene is missing a part" );
+            parts[ first[object] + slot ] = NULL;
+            return part;
+        }
+
+    private:
+        std::vector< size_t > first; // Where the slots of each Object begin
+        std::vector< Part* >  parts;
+        std::vector< bool >   borrowed;
+    };
+
+    // Also false for NaNs
+    static bool inUnitRange( double value )
+    {
+        return 0 <= value && value <= 1;
+    }
+
+    // Parts may belong to any Light or Thing, and nothing else
+    static void checkObject( const FileHeader& header, const PartRecord& record )
+    {
+        if ( (uint64_t)header.lightCount + header.thingCount <= record.object )
+            throw std::string( "the compiled scene refers to an object that doesn't exist" );
+    }
+
+    Camera* loadCompiledScene( const char* data, size_t size )
+    {
+        if ( !isCompiledScene( data, size ) )
+            throw std::string( "not a compiled scene" );
+        if ( size < sizeof(FileHeader) + sizeof(GlobalsRecord) )
+            throw std::string( "the compiled scene is truncated or corrupted" );
+        RecordReader reader( data );
+        const FileHeader header = reader.next< FileHeader >();
+        if ( byteOrder != header.byteOrder )
+            throw std::string( "the compiled scene was written on a machine with a different byte order; please compile it again" );
+        if ( version != header.version )
+            throw std::string( "the compiled scene is of a different version; please compile it again" );
+        const uint64_t expectedSize = sizeof(FileHeader) + sizeof(GlobalsRecord)
+                                    + (uint64_t)header.lightCount    * sizeof(LightRecord)
+                                    + (uint64_t)header.thingCount    * sizeof(ThingRecord)
+                                    + (uint64_t)header.materialCount * sizeof(MaterialRecord)
+                                    + (uint64_t)header.pointCount    * sizeof(PointRecord)
+                                    + (uint64_t)header.sphereCount   * sizeof(SphereRecord)
+                                    + (uint64_t)header.planeCount    * sizeof(PlaneRecord)
+                                    + (uint64_t)header.triangleCount * sizeof(TriangleRecord)
+                                    + (uint64_t)header.meshCount     * sizeof(MeshRecord);
+        if ( size < expectedSize )
+            throw std::string( "the compiled scene is truncated or corrupted" );
+        // The mesh data follows the records, so the meshes are needed to tell how long the file should be
+        uint64_t meshSize  = 0;
+        uint64_t partCount = (uint64_t)header.pointCount + header.sphereCount + header.planeCount + header.triangleCount;
+        RecordReader meshReader( data + expectedSize - (uint64_t)header.meshCount * sizeof(MeshRecord) );
+        for ( uint32_t i = 0; i < header.meshCount; ++i )
+        {
+            const MeshRecord record = meshReader.next< MeshRecord >();
+            meshSize  += meshDataSize( record );
+            partCount += record.faceCount;
+        }
+        if ( expectedSize + meshSize != size )
+            throw std::string( "the compiled scene is truncated or corrupted" );
+
+        const GlobalsRecord globals = reader.next< GlobalsRecord >();
+        if ( globals.gridwidth <= 0 || globals.gridheight <= 0 )
+            throw std::string( "the compiled scene is truncated or corrupted" );
+        Scene* scene = new Scene;
+        std::map< std::pair< uint32_t, uint32_t >, Mesh* > meshes; // By Thing and first slot, until they're handed over
+        try {
+            for ( int i = 0; i < 3; ++i )
+                if ( !inUnitRange(globals.sky[i]) )
+                    throw std::string( "the compiled scene is truncated or corrupted" );
+            scene->setSky( RGB(globals.sky[0], globals.sky[1], globals.sky[2]) );
+
+            // Create all Objects first so the parts have their parents to point to
+            std::vector< Light* > lights( header.lightCount );
+            std::vector< Thing* > things( header.thingCount );
+            PartSlots< LightPart > lightSlots( header.lightCount );
+            PartSlots< ThingPart > thingSlots( header.thingCount );
+            for ( uint32_t i = 0; i < header.lightCount; ++i )
+            {
+                const LightRecord record = reader.next< LightRecord >();
+                lights[i] = new Light( scene );
+                scene->add( lights[i] );
+                lights[i]->setEmission( load(record.emission) );
+                lights[i]->setBackground( record.background );
+                lights[i]->setBackCulled( record.backCulled );
+                lightSlots.setCount( i, record.partCount );
+            }
+            uint64_t slotCount = 0;
+            for ( uint32_t i = 0; i < header.lightCount; ++i )
+                slotCount += lightSlots.getCount( i );
+            std::vector< uint32_t > thingMaterials( header.thingCount );
+            for ( uint32_t i = 0; i < header.thingCount; ++i )
+            {
+                const ThingRecord record = reader.next< ThingRecord >();
+                slotCount += record.partCount;
+                things[i] = new Thing( scene );
+                scene->add( things[i] );
+                things[i]->setBackground( record.background );
+                things[i]->setBackCulled( record.backCulled );
+                if ( header.materialCount <= record.material )
+                    throw std::string( "the compiled scene refers to a material that doesn't exist" );
+                thingMaterials[i] = record.material;
+                thingSlots.setCount( i, record.partCount );
+            }
+            // Every slot is filled by exactly one part, so there can't be more of them than parts
+            if ( partCount != slotCount )
+                throw std::string( "the compiled scene is truncated or corrupted" );
+            lightSlots.allocate();
+            thingSlots.allocate();
+            std::vector< Material > materials;
+            for ( uint32_t i = 0; i < header.materialCount; ++i )
+            {
+                const MaterialRecord record = reader.next< MaterialRecord >();
+                const double* c = record.character;
+                for ( int j = 0; j < 4; ++j )
+                    if ( !inUnitRange(c[j]) || !inUnitRange(record.color[j % 3]) )
+                        throw std::string( "the compiled scene is truncated or corrupted" );
+                if ( !equal(c[0] + c[1] + c[2] + c[3], 1) )
+                    throw std::string( "the compiled scene is truncated or corrupted" );
+                materials.push_back( Material(c[0], c[1], c[2], c[3], RGB(record.color[0], record.color[1], record.color[2])) );
+                materials.back().setRefractiveIndex( record.refractiveIndex );
+            }
+            for ( uint32_t i = 0; i < header.thingCount; ++i )
+                things[i]->setMaterial( materials[ thingMaterials[i] ] );
+
+            for ( uint32_t i = 0; i < header.pointCount; ++i )
+            {
+                const PointRecord record = reader.next< PointRecord >();
+                if ( header.lightCount <= record.object )
+                    throw std::string( "the compiled scene has a point in a Thing" );
+                lightSlots.at( record.object, record.slot ) = new LightPoint( lights[record.object], load(record.point) );
+            }
+            for ( uint32_t i = 0; i < header.sphereCount; ++i )
+            {
+                const SphereRecord record = reader.next< SphereRecord >();
+                checkObject( header, record );
+                const uint32_t thing = record.object - header.lightCount;
+                if ( record.object < header.lightCount )
+                    lightSlots.at( record.object, record.slot ) = new LightSphere( lights[record.object], load(record.center), record.radius );
+                else
+                    thingSlots.at( thing, record.slot ) = new Sphere( things[thing], load(record.center), record.radius );
+            }
+            for ( uint32_t i = 0; i < header.planeCount; ++i )
+            {
+                const PlaneRecord record = reader.next< PlaneRecord >();
+                checkObject( header, record );
+                const uint32_t thing = record.object - header.lightCount;
+                if ( record.object < header.lightCount )
+                    lightSlots.at( record.object, record.slot ) = new LightPlane( lights[record.object], load(record.normal), record.offset );
+                else
+                    thingSlots.at( thing, record.slot ) = new Plane( things[thing], load(record.normal), record.offset );
+            }
+            for ( uint32_t i = 0; i < header.triangleCount; ++i )
+            {
+                const TriangleRecord record = reader.next< TriangleRecord >();
+                checkObject( header, record );
+                const uint32_t thing = record.object - header.lightCount;
+                const Vector a = load( record.points[0] ), b = load( record.points[1] ), c = load( record.points[2] );
+                if ( record.object < header.lightCount )
+                    lightSlots.at( record.object, record.slot ) = new LightTriangle( lights[record.object], a, b, c );
+                else
+                    thingSlots.at( thing, record.slot ) = new Triangle( things[thing], a, b, c );
+            }
+
+            std::vector< MeshRecord > meshRecords;
+            std::vector< const Mesh* > loadedMeshes;
+            for ( uint32_t i = 0; i < header.meshCount; ++i )
+                meshRecords.push_back( reader.next< MeshRecord >() );
+            for ( std::vector< MeshRecord >::const_iterator record = meshRecords.begin(); record != meshRecords.end(); record++ )
+            {
+                if ( record->object < header.lightCount )
+                    throw std::string( "the compiled scene has a mesh in a Light" );
+                const uint32_t thing = record->object - header.lightCount;
+                if ( header.thingCount <= thing || 0 == record->faceCount || thingSlots.getCount(thing) < record->faceCount
+                  || thingSlots.getCount(thing) - record->faceCount < record->slot )
+                    throw std::string( "the compiled scene refers to a part that doesn't exist" );
+                std::vector< Vector > vertices( record->vertexCount );
+                for ( uint32_t i = 0; i < record->vertexCount; ++i )
+                {
+                    double vertex[3];
+                    for ( int j = 0; j < 3; ++j )
+                        vertex[j] = reader.next< double >();
+                    vertices[i] = load( vertex );
+                }
+                Mesh* mesh = NULL;
+                if ( noMesh != record->topology )
+                {
+                    if ( loadedMeshes.size() <= record->topology || loadedMeshes[record->topology]->getVertexCount() != record->vertexCount
+                                                                 || loadedMeshes[record->topology]->getFaceCount()   != record->faceCount )
+                        throw std::string( "the compiled scene has an instance of a mesh that doesn't match it" );
+                    mesh = new Mesh( things[thing], vertices, *loadedMeshes[record->topology] );
+                }
+                else
+                {
+                    std::vector< unsigned int > indices( 3 * record->faceCount );
+                    for ( uint32_t i = 0; i < 3 * record->faceCount; ++i )
+                    {
+                        indices[i] = reader.next< uint32_t >();
+                        if ( record->vertexCount <= indices[i] )
+                            throw std::string( "the compiled scene has a mesh face with a vertex that doesn't exist" );
+                    }
+                    if ( record->faceCount % 2 )
+                        reader.next< uint32_t >(); // Padding
+                    mesh = new Mesh( things[thing], vertices, indices );
+                }
+                loadedMeshes.push_back( mesh );
+                meshes[ std::make_pair(thing, record->slot) ] = mesh;
+                for ( uint32_t face = 0; face < record->faceCount; ++face )
+                    thingSlots.borrow( thing, record->slot + face, mesh->getFace(face) );
+            }
+
+            // Hand the parts over to their Objects in their original order
+            for ( uint32_t i = 0; i < header.lightCount; ++i )
+                for ( uint32_t slot = 0; slot < lightSlots.getCount(i); ++slot )
+                    lights[i]->push_back( lightSlots.take(i, slot) );
+            for ( uint32_t i = 0; i < header.thingCount; ++i )
+                for ( uint32_t slot = 0; slot < thingSlots.getCount(i); ++slot )
+                {
+                    ThingPart* part = thingSlots.take( i, slot );
+                    const std::map< std::pair< uint32_t, uint32_t >, Mesh* >::iterator mesh = meshes.find( std::make_pair(i, slot) );
+                    if ( mesh == meshes.end() )
+                        things[i]->push_back( part );
+                    else
+                    {
+                        // The first face stands for the whole Mesh
+                        for ( uint32_t face = 1; face < mesh->second->getFaceCount(); ++face )
+                            thingSlots.take( i, ++slot );
+                        things[i]->push_back( mesh->second );
+                        meshes.erase( mesh );
+                    }
+                }
+        }
+        catch( const std::string& ) {
+            for ( std::map< std::pair< uint32_t, uint32_t >, Mesh* >::iterator mesh = meshes.begin(); mesh != meshes.end(); mesh++ )
+                delete mesh->second;
+            delete scene;
+            throw;
+        }
+        const double (*window)[3] = globals.window;
+        return new Camera( scene, load(globals.viewpoint), load(window[0]), load(window[1]), load(window[2]), load(window[3]),
+                           globals.gridwidth, globals.gridheight );
+    }
+
+}
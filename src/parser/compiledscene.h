@@ -0,0 +1,41 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A compact binary form of scene descriptions that loads without any parsing
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_COMPILEDSCENE
+#define SILENCE_COMPILEDSCENE
+
+#include <cstddef>
+#include <ostream>
+
+namespace Silence {
+
+    class Camera;
+
+    // Write the Scene of a Camera and the Camera itself in compiled form
+    void    compileScene( std::ostream& os, const Camera& camera );
+
+    bool    isCompiledScene  ( const char* data, size_t size );
+    Camera* loadCompiledScene( const char* data, size_t size ); // Throws a message if the data is not a valid compiled scene
+
+}
+
+#endif // SILENCE_COMPILEDSCENE
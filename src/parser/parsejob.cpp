@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A parser for render server jobs, each one a JSON object on a single line
+// (Like the other parsers this one is non-strict, but it doesn't need
+// whitespace between tokens because jobs are usually machine generated)
+// Part of Silence, an experimental rendering engine
+
+#include "parsejob.h"
+
+#include <sstream>
+
+#include "../core/camera.h"
+
+#include "../server/server.h"
+
+namespace Silence {
+
+    // Read a quoted JSON string and resolve its escape sequences
+    static std::string readString( std::istream& is )
+    {
+        is >> std::ws;
+        if ( '"' != is.get() )
+            throw std::string( "expected a string in job description" );
+        std::string string;
+        char c;
+        while ( is.get(c) && '"' != c )
+        {
+            if ( '\\' == c && is.get(c) )
+            {
+                switch ( c )
+                {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    default:            break; // \" \\ and \/ stand for themselves
+                }
+            }
+            string += c;
+        }
+        if ( !is )
+            throw std::string( "unterminated string in job description" );
+        return string;
+    }
+
+    template< typename T >
+    static void readNumber( std::istream& is, T& number, const std::string& key )
+    {
+        is >> number;
+        if ( !is )
+            throw std::string( "expected a number for \"" + key + "\" in job description" );
+    }
+
+    void parseJob( std::istream& is, Job& job )
+    {
+        is >> std::ws;
+        if ( '{' != is.get() )
+            throw std::string( "a job must be a JSON object" );
+        while ( true )
+        {
+            is >> std::ws;
+            const int next = is.peek();
+            if ( std::char_traits< char >::eof() == next )
+                throw std::string( "unterminated job description" );
+            if ( '}' == next )
+            {
+                is.get();
+                break;
+            }
+            if ( ',' == next )
+            {
+                is.get();
+                continue;
+            }
+            const std::string key = readString( is );
+            is >> std::ws;
+            if ( ':' != is.get() )
+                throw std::string( "expected ':' after \"" + key + "\" in job description" );
+            is >> std::ws;
+            if      ( key == "id"     )
+            {
+                if ( '"' == is.peek() )
+                    job.id = readString( is );
+                else
+                {
+                    long id;
+                    readNumber( is, id, key );
+                    std::ostringstream oss;
+                    oss << id;
+                    job.id = oss.str();
+                }
+            }
+            else if ( key == "scene"  )
+            {
+                job.sceneFilename = readString( is );
+            }
+            else if ( key == "camera" )
+            {
+                Camera* camera = new Camera( NULL ); // Just a pose, it will never see the Scene
+                job.camera.reset( camera );
+                is >> *camera;
+            }
+            else if ( key == "depth"  )
+            {
+                readNumber( is, job.depth, key );
+                if ( job.depth <= 0 )
+                    throw std::string( "\"depth\" must be positive" );
+            }
+            else if ( key == "level"  )
+            {
+                readNumber( is, job.level, key );
+                if ( job.level < -1 )
+                    throw std::string( "\"level\" must be -1 (all levels) or more" );
+            }
+            else if ( key == "cutoff" )
+            {
+                readNumber( is, job.cutoff, key );
+            }
+            else if ( key == "gamma"  )
+            {
+                readNumber( is, job.gamma, key );
+                if ( !job.gamma )
+                    throw std::string( "\"gamma\" must not be zero" );
+            }
+            else if ( key == "output" )
+            {
+                job.outFilename = readString( is );
+            }
+            else
+                throw std::string( "unrecognized key in job description: \"" + key + "\"" );
+        }
+        if ( job.sceneFilename.empty() )
+            throw std::string( "the job has no \"scene\"" );
+        if ( job.outFilename.empty() || job.outFilename == "-" )
+            throw std::string( "the job needs an \"output\" file" );
+        if ( job.depth - 1 < job.level )
+            throw std::string( "\"level\" is deeper than \"depth\" allows" );
+    }
+
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A parser for render server jobs, each one a JSON object on a single line
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_PARSEJOB
+#define SILENCE_PARSEJOB
+
+#include <istream>
+
+namespace Silence {
+
+    struct Job;
+
+    // Settings missing from the description are left as they were in 'job'
+    void parseJob( std::istream& is, Job& job );
+
+}
+
+#endif // SILENCE_PARSEJOB
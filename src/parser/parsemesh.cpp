@@ -0,0 +1,503 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Importers for triangle meshes stored in OBJ or binary PLY files
+// Both are read straight out of the mapped file: OBJ text in parallel chunks of whole lines,
+// PLY vertex and face records in parallel as long as they are all the same size
+// Part of Silence, an experimental rendering engine
+
+#include "parsemesh.h"
+#include "parsenumber.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../core/aux.h"
+
+namespace Silence {
+
+    // The whole contents of a file, mapped into memory if possible
+    class MeshFile {
+    public:
+        MeshFile( const char* filename )
+            : data( NULL )
+            , size( 0 )
+            , mapped( false )
+        {
+            const int fd = open( filename, O_RDONLY );
+            if ( -1 == fd )
+                throw std::string( "cannot read mesh file " ) + filename;
+            struct stat info;
+            if ( 0 == fstat( fd, &info ) && S_ISREG( info.st_mode ) && 0 < info.st_size )
+            {
+                void* const map = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                if ( MAP_FAILED != map )
+                {
+                    data   = (const char*)map;
+                    size   = info.st_size;
+                    mapped = true;
+                }
+            }
+            close( fd );
+            if ( !mapped )
+            {
+                std::ifstream ifs( filename, std::ios::binary );
+                std::ostringstream buffer;
+                buffer << ifs.rdbuf();
+                contents = buffer.str();
+                data = contents.data();
+                size = contents.size();
+            }
+        }
+        ~MeshFile()
+        {
+            if ( mapped )
+                munmap( (void*)data, size );
+        }
+
+        const char* data;
+        size_t      size;
+
+    private:
+        MeshFile( const MeshFile& );
+        MeshFile& operator=( const MeshFile& );
+
+        bool        mapped;
+        std::string contents;
+    };
+
+    // What a run of whole lines of an OBJ file holds
+    struct ObjChunk {
+        std::vector< Vector >    vertices;
+        std::vector< long long > corners;  // Zero-based vertex indices, three per triangle
+        std::vector< size_t >    relative; // Corners counted back from the last vertex of this chunk so far (negative indices in the file)
+        std::string              error;
+    };
+
+    static void parseObjChunk( const char* pos, const char* end, ObjChunk& chunk )
+    {
+        std::vector< long long > polygon;
+        while ( pos != end )
+        {
+            while ( pos != end && (' ' == *pos || '\t' == *pos) )
+                ++pos;
+            const char* const line = pos;
+            while ( pos != end && '\n' != *pos )
+                ++pos;
+            const char* const lineEnd = pos;
+            if ( pos != end )
+                ++pos;
+            if ( 2 > lineEnd - line || (' ' != line[1] && '\t' != line[1]) )
+                continue; // Not a vertex or a face, or nothing else we care about either
+            const char* p = line + 2;
+            if ( 'v' == line[0] )
+            {
+                double xyz[3];
+                for ( int i = 0; i < 3 && p; ++i )
+                {
+                    while ( p != lineEnd && (' ' == *p || '\t' == *p) )
+                        ++p;
+                    p = scanNumber( p, lineEnd, xyz[i] );
+                }
+                if ( !p )
+                {
+                    chunk.error = "malformed vertex \"" + std::string( line, lineEnd ) + "\"";
+                    return;
+                }
+                chunk.vertices.push_back( Vector( xyz[0], xyz[1], xyz[2] ) );
+            }
+            else if ( 'f' == line[0] )
+            {
+                polygon.clear();
+                while ( true )
+                {
+                    while ( p != lineEnd && (' ' == *p || '\t' == *p || '\r' == *p) )
+                        ++p;
+                    if ( p == lineEnd )
+                        break;
+                    const bool negative = '-' == *p;
+                    if ( negative )
+                        ++p;
+                    long long index = 0;
+                    const char* const digits = p;
+                    for ( ; p != lineEnd && '0' <= *p && *p <= '9'; ++p )
+                        index = 10 * index + (*p - '0');
+                    if ( p == digits || 0 == index )
+                    {
+                        chunk.error = "malformed face \"" + std::string( line, lineEnd ) + "\"";
+                        return;
+                    }
+                    // Texture coordinates and normals are of no use to us
+                    while ( p != lineEnd && ' ' != *p && '\t' != *p && '\r' != *p )
+                        ++p;
+                    polygon.push_back( negative ? -index : index - 1 );
+                }
+                if ( polygon.size() < 3 )
+                {
+                    chunk.error = "face with fewer than three vertices \"" + std::string( line, lineEnd ) + "\"";
+                    return;
+                }
+                for ( size_t i = 1; i + 1 < polygon.size(); ++i )
+                {
+                    const long long triangle[3] = { polygon[0], polygon[i], polygon[i + 1] };
+                    for ( int j = 0; j < 3; ++j )
+                    {
+                        if ( triangle[j] < 0 )
+                        {
+                            chunk.relative.push_back( chunk.corners.size() );
+                            chunk.corners.push_back( (long long)chunk.vertices.size() + triangle[j] );
+                        }
+                        else
+                            chunk.corners.push_back( triangle[j] );
+                    }
+                }
+            }
+        }
+    }
+
+    static void parseObj( const char* data, size_t size, std::vector< Vector >& vertices, std::vector< unsigned int >& indices )
+    {
+        // Small files are not worth the threads
+        const int chunkCount = size < (1 << 20) ? 1 : omp_get_max_threads();
+        std::vector< const char* > bounds( chunkCount + 1 );
+        bounds[0] = data;
+        bounds[chunkCount] = data + size;
+        for ( int i = 1; i < chunkCount; ++i )
+        {
+            const char* bound = std::max( bounds[i - 1], data + size / chunkCount * i );
+            while ( bound != data + size && '\n' != bound[-1] )
+                ++bound;
+            bounds[i] = bound;
+        }
+        std::vector< ObjChunk > chunks( chunkCount );
+        #pragma omp parallel for schedule(static, 1)
+        for ( int i = 0; i < chunkCount; ++i )
+            parseObjChunk( bounds[i], bounds[i + 1], chunks[i] );
+
+        const size_t firstVertex = vertices.size();
+        size_t vertexCount = 0, cornerCount = 0;
+        for ( int i = 0; i < chunkCount; ++i )
+        {
+            if ( !chunks[i].error.empty() )
+                throw chunks[i].error;
+            vertexCount += chunks[i].vertices.size();
+            cornerCount += chunks[i].corners.size();
+        }
+        vertices.reserve( vertices.size() + vertexCount );
+        indices .reserve( indices .size() + cornerCount );
+        for ( int i = 0; i < chunkCount; ++i )
+        {
+            const long long base = vertices.size() - firstVertex; // Vertices in the file before this chunk
+            for ( std::vector< size_t >::const_iterator corner = chunks[i].relative.begin(); corner != chunks[i].relative.end(); corner++ )
+                chunks[i].corners[*corner] += base;
+            for ( std::vector< long long >::const_iterator corner = chunks[i].corners.begin(); corner != chunks[i].corners.end(); corner++ )
+            {
+                if ( *corner < 0 || (long long)vertexCount <= *corner )
+                    throw std::string( "a face refers to a vertex that doesn't exist" );
+                indices.push_back( firstVertex + *corner );
+            }
+            vertices.insert( vertices.end(), chunks[i].vertices.begin(), chunks[i].vertices.end() );
+            std::vector< Vector >().swap( chunks[i].vertices );
+        }
+    }
+
+    // The scalar types of PLY properties
+    enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+    static PlyType plyType( const std::string& name )
+    {
+        static const char* const names[][2] = { { "char",  "int8"    }, { "uchar",  "uint8"   },
+                                                 { "short", "int16"   }, { "ushort", "uint16"  },
+                                                 { "int",   "int32"   }, { "uint",   "uint32"  },
+                                                 { "float", "float32" }, { "double", "float64" } };
+        for ( int i = 0; i < PLY_INVALID; ++i )
+            if ( name == names[i][0] || name == names[i][1] )
+                return PlyType( i );
+        return PLY_INVALID;
+    }
+
+    static int plySize( PlyType type )
+    {
+        static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+        return sizes[type];
+    }
+
+    // Read a single scalar, swapping its bytes if the file's byte order is not ours
+    static double plyValue( const char* pos, PlyType type, bool swap )
+    {
+        char bytes[8];
+        const int size = plySize( type );
+        for ( int i = 0; i < size; ++i )
+            bytes[i] = pos[ swap ? size - 1 - i : i ];
+        switch ( type )
+        {
+            case PLY_INT8:    { int8_t   value; memcpy( &value, bytes, 1 ); return value; }
+            case PLY_UINT8:   { uint8_t  value; memcpy( &value, bytes, 1 ); return value; }
+            case PLY_INT16:   { int16_t  value; memcpy( &value, bytes, 2 ); return value; }
+            case PLY_UINT16:  { uint16_t value; memcpy( &value, bytes, 2 ); return value; }
+            case PLY_INT32:   { int32_t  value; memcpy( &value, bytes, 4 ); return value; }
+            case PLY_UINT32:  { uint32_t value; memcpy( &value, bytes, 4 ); return value; }
+            case PLY_FLOAT32: { float    value; memcpy( &value, bytes, 4 ); return value; }
+            case PLY_FLOAT64: { double   value; memcpy( &value, bytes, 8 ); return value; }
+            default:          assert( false ); return 0;
+        }
+    }
+
+    struct PlyProperty {
+        std::string name;
+        PlyType     type;
+        PlyType     countType; // PLY_INVALID unless it's a list
+    };
+
+    struct PlyElement {
+        std::string                 name;
+        size_t                      count;
+        std::vector< PlyProperty >  properties;
+
+        // Bytes per record, or 0 if it has lists and every record has to be measured on its own
+        size_t stride() const
+        {
+            size_t size = 0;
+            for ( std::vector< PlyProperty >::const_iterator property = properties.begin(); property != properties.end(); property++ )
+            {
+                if ( PLY_INVALID != property->countType )
+                    return 0;
+                size += plySize( property->type );
+            }
+            return size;
+        }
+    };
+
+    static void parsePly( const char* data, size_t size, std::vector< Vector >& vertices, std::vector< unsigned int >& indices )
+    {
+        static const char headerEnd[] = "end_header\n";
+        const char* const end = data + size;
+        const char* const body = std::search( data, end, headerEnd, headerEnd + sizeof(headerEnd) - 1 );
+        if ( body == end )
+            throw std::string( "the PLY header has no end" );
+        std::istringstream header( std::string( data, body ) );
+        std::vector< PlyElement > elements;
+        std::string line, word;
+        bool swap = false, formatDefined = false;
+        std::getline( header, line ); // "ply"
+        while ( std::getline( header, line ) )
+        {
+            std::istringstream words( line );
+            words >> word;
+            if      ( "format" == word )
+            {
+                words >> word;
+                const uint16_t one = 1;
+                const bool littleEndian = 1 == *(const char*)&one;
+                if      ( "binary_little_endian" == word )
+                    swap = !littleEndian;
+                else if ( "binary_big_endian"    == word )
+                    swap =  littleEndian;
+                else
+                    throw std::string( "only binary PLY files are supported" );
+                formatDefined = true;
+            }
+            else if ( "element" == word )
+            {
+                PlyElement element;
+                if ( !(words >> element.name >> element.count) )
+                    throw std::string( "malformed PLY header line \"" + line + "\"" );
+                elements.push_back( element );
+            }
+            else if ( "property" == word )
+            {
+                PlyProperty property;
+                property.countType = PLY_INVALID;
+                words >> word;
+                if ( "list" == word )
+                {
+                    words >> word;
+                    property.countType = plyType( word );
+                    words >> word;
+                    if ( PLY_INVALID == property.countType || PLY_FLOAT32 <= property.countType )
+                        throw std::string( "malformed PLY header line \"" + line + "\"" );
+                }
+                property.type = plyType( word );
+                if ( !(words >> property.name) || PLY_INVALID == property.type || elements.empty() )
+                    throw std::string( "malformed PLY header line \"" + line + "\"" );
+                elements.back().properties.push_back( property );
+            }
+        }
+        if ( !formatDefined )
+            throw std::string( "the PLY header has no format" );
+
+        const char* pos = body + sizeof(headerEnd) - 1;
+        const size_t firstVertex = vertices.size();
+        size_t vertexCount = 0;
+        for ( std::vector< PlyElement >::const_iterator element = elements.begin(); element != elements.end(); element++ )
+        {
+            const size_t stride = element->stride();
+            if ( "vertex" == element->name )
+            {
+                if ( 0 < vertexCount )
+                    throw std::string( "the PLY file has more than one vertex element" );
+                int    coordinate[3] = { -1, -1, -1 };
+                size_t offset[3]     = { 0, 0, 0 };
+                size_t at = 0;
+                for ( size_t i = 0; i < element->properties.size(); ++i )
+                {
+                    const std::string& name = element->properties[i].name;
+                    for ( int j = 0; j < 3; ++j )
+                        if ( name == std::string( 1, 'x' + j ) )
+                        {
+                            coordinate[j] = i;
+                            offset[j]     = at;
+                        }
+                    at += plySize( element->properties[i].type );
+                }
+                if ( !stride || coordinate[0] < 0 || coordinate[1] < 0 || coordinate[2] < 0 )
+                    throw std::string( "the vertices of the PLY file must have x, y and z and no lists" );
+                if ( (size_t)(end - pos) / stride < element->count )
+                    throw std::string( "the PLY file is truncated" );
+                vertexCount = element->count;
+                vertices.resize( firstVertex + vertexCount );
+                const PlyType types[3] = { element->properties[coordinate[0]].type,
+                                           element->properties[coordinate[1]].type,
+                                           element->properties[coordinate[2]].type };
+                #pragma omp parallel for
+                for ( long long i = 0; i < (long long)vertexCount; ++i )
+                {
+                    const char* const record = pos + i * stride;
+                    vertices[firstVertex + i] = Vector( plyValue( record + offset[0], types[0], swap ),
+                                                        plyValue( record + offset[1], types[1], swap ),
+                                                        plyValue( record + offset[2], types[2], swap ) );
+                }
+                pos += vertexCount * stride;
+                continue;
+            }
+
+            const bool faces = "face" == element->name;
+            const PlyProperty* const list = faces && 1 == element->properties.size() ? &element->properties[0] : NULL;
+            if ( faces && (!list || PLY_INVALID == list->countType || ("vertex_indices" != list->name && "vertex_index" != list->name)) )
+                throw std::string( "the faces of the PLY file must have nothing but a list of vertex indices" );
+            if ( faces && PLY_FLOAT32 <= list->type )
+                throw std::string( "the vertex indices of the PLY file must be integers" );
+            if ( stride )
+            {
+                // Some other element of fixed size
+                if ( (size_t)(end - pos) / stride < element->count )
+                    throw std::string( "the PLY file is truncated" );
+                pos += element->count * stride;
+                continue;
+            }
+
+            // Faces are usually all triangles: then they're all the same size and can be read in parallel
+            const size_t firstIndex = indices.size();
+            if ( faces )
+            {
+                const size_t countSize = plySize( list->countType ), indexSize = plySize( list->type );
+                const size_t triangleSize = countSize + 3 * indexSize;
+                if ( (size_t)(end - pos) / triangleSize >= element->count && 0 < element->count )
+                {
+                    bool triangles = true, valid = true;
+                    indices.resize( firstIndex + 3 * element->count );
+                    #pragma omp parallel for reduction(&&: triangles, valid)
+                    for ( long long i = 0; i < (long long)element->count; ++i )
+                    {
+                        const char* const record = pos + i * triangleSize;
+                        triangles = triangles && 3 == plyValue( record, list->countType, swap );
+                        for ( int j = 0; j < 3 && triangles; ++j )
+                        {
+                            const double index = plyValue( record + countSize + j * indexSize, list->type, swap );
+                            valid = valid && 0 <= index && index < vertexCount;
+                            indices[firstIndex + 3 * i + j] = firstVertex + (size_t)index;
+                        }
+                    }
+                    if ( triangles )
+                    {
+                        if ( !valid )
+                            throw std::string( "a face refers to a vertex that doesn't exist" );
+                        pos += element->count * triangleSize;
+                        continue;
+                    }
+                    indices.resize( firstIndex );
+                }
+            }
+
+            // Walk the records one by one
+            for ( size_t i = 0; i < element->count; ++i )
+                for ( std::vector< PlyProperty >::const_iterator property = element->properties.begin(); property != element->properties.end(); property++ )
+                {
+                    size_t count = 1;
+                    if ( PLY_INVALID != property->countType )
+                    {
+                        if ( end - pos < plySize( property->countType ) )
+                            throw std::string( "the PLY file is truncated" );
+                        count = plyValue( pos, property->countType, swap );
+                        pos += plySize( property->countType );
+                    }
+                    if ( (size_t)(end - pos) / plySize( property->type ) < count )
+                        throw std::string( "the PLY file is truncated" );
+                    if ( faces )
+                    {
+                        if ( count < 3 )
+                            throw std::string( "the PLY file has a face with fewer than three vertices" );
+                        std::vector< double > polygon( count );
+                        for ( size_t j = 0; j < count; ++j )
+                        {
+                            polygon[j] = plyValue( pos + j * plySize( property->type ), property->type, swap );
+                            if ( polygon[j] < 0 || vertexCount <= polygon[j] )
+                                throw std::string( "a face refers to a vertex that doesn't exist" );
+                        }
+                        for ( size_t j = 1; j + 1 < count; ++j )
+                        {
+                            indices.push_back( firstVertex + (size_t)polygon[0] );
+                            indices.push_back( firstVertex + (size_t)polygon[j] );
+                            indices.push_back( firstVertex + (size_t)polygon[j + 1] );
+                        }
+                    }
+                    pos += count * plySize( property->type );
+                }
+        }
+    }
+
+    void parseMeshFile( const char* filename, std::vector< Vector >& vertices, std::vector< unsigned int >& indices )
+    {
+        const MeshFile file( filename );
+        try {
+            if ( 4 <= file.size && !memcmp( file.data, "ply", 3 ) && ('\n' == file.data[3] || '\r' == file.data[3]) )
+                parsePly( file.data, file.size, vertices, indices );
+            else
+                parseObj( file.data, file.size, vertices, indices );
+        }
+        catch( const std::string& message ) {
+            throw std::string( filename ) + ": " + message;
+        }
+        if ( modeFlags.verbose )
+            std::cerr << "parseMeshFile: read " << vertices.size() << " vertices and " << indices.size() / 3 << " triangles from " << filename << "." << std::endl;
+    }
+
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Importers for triangle meshes stored in OBJ or binary PLY files
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_PARSEMESH
+#define SILENCE_PARSEMESH
+
+#include <vector>
+
+#include "../core/triplet.h"
+
+namespace Silence {
+
+    // Read all faces of an OBJ or binary PLY file (told apart by their contents) as triangles:
+    // the vertices and three vertex indices per triangle are appended to the arrays.
+    // Polygons are split into fans of triangles. Throws a message if the file cannot be read or parsed
+    void parseMeshFile( const char* filename, std::vector< Vector >& vertices, std::vector< unsigned int >& indices );
+
+}
+
+#endif // SILENCE_PARSEMESH
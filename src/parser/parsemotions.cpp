@@ -126,7 +126,8 @@ namespace Silence {
         {
             case 0:
             {
-                BrownianMotion* motion = new BrownianMotion( object, scale );
+                // Number the streams by position in the file so copies of the Scene move alike
+                BrownianMotion* motion = new BrownianMotion( object, scale, motions.size() );
                 motions.push_back( motion );
                 break;
             }
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Decimal number scanner shared by the scene and mesh parsers
+// Part of Silence, an experimental rendering engine
+
+#include "parsenumber.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+namespace Silence {
+
+    // Up to 15 significant digits and a power of ten up to 22 are both exact in a double, so their
+    // product or quotient is correctly rounded. Anything longer is left to strtod
+    const char* scanNumber( const char* pos, const char* end, double& value )
+    {
+        static const double powersOfTen[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                              1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        const char* const start = pos;
+        bool negative = false;
+        if ( pos != end && ('-' == *pos || '+' == *pos) )
+            negative = '-' == *pos++;
+        unsigned long long mantissa = 0;
+        int  digits   = 0; // Significant ones in the mantissa
+        int  exponent = 0;
+        bool seen     = false;
+        for ( ; pos != end && '0' <= *pos && *pos <= '9'; ++pos, seen = true )
+        {
+            if ( digits < 19 )
+            {
+                mantissa = 10 * mantissa + (*pos - '0');
+                digits  += 0 < mantissa;
+            }
+            else
+                ++exponent;
+        }
+        if ( pos != end && '.' == *pos )
+        {
+            for ( ++pos; pos != end && '0' <= *pos && *pos <= '9'; ++pos, seen = true )
+            {
+                if ( digits < 19 )
+                {
+                    mantissa = 10 * mantissa + (*pos - '0');
+                    digits  += 0 < mantissa;
+                    --exponent;
+                }
+            }
+        }
+        if ( !seen )
+            return NULL;
+        if ( pos != end && ('e' == *pos || 'E' == *pos) )
+        {
+            ++pos;
+            bool negativeExponent = false;
+            if ( pos != end && ('-' == *pos || '+' == *pos) )
+                negativeExponent = '-' == *pos++;
+            if ( pos == end || *pos < '0' || '9' < *pos )
+                return NULL;
+            int e = 0;
+            for ( ; pos != end && '0' <= *pos && *pos <= '9'; ++pos )
+                e = std::min( 10 * e + (*pos - '0'), 100000 );
+            exponent += negativeExponent ? -e : e;
+        }
+        if ( !mantissa )
+            value = 0;
+        else if ( digits <= 15 && -22 <= exponent && exponent <= 22 )
+        {
+            value = 0 <= exponent ? mantissa * powersOfTen[exponent] : mantissa / powersOfTen[-exponent];
+            value = negative ? -value : value;
+        }
+        else
+            value = strtod( std::string( start, pos ).c_str(), NULL );
+        return pos;
+    }
+
+}
+
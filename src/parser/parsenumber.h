@@ -0,0 +1,36 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Decimal number scanner shared by the scene and mesh parsers
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_PARSENUMBER
+#define SILENCE_PARSENUMBER
+
+namespace Silence {
+
+    // Convert the number at the start of [pos, end) without copying it: an optional sign, digits with an optional
+    // fraction and an optional exponent. No whitespace is skipped. Returns where the number ends, or NULL if there isn't one
+    const char* scanNumber( const char* pos, const char* end, double& value );
+
+}
+
+#endif // SILENCE_PARSENUMBER
+
@@ -23,10 +23,21 @@
 // Part of Silence, an experimental rendering engine
 
 #include "parsescene.h"
+#include "compiledscene.h"
+#include "parsemesh.h"
+#include "parsenumber.h"
 
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <limits>
+#include <map>
 #include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../core/camera.h"
 #include "../core/material.h"
@@ -34,879 +45,767 @@
 
 namespace Silence {
 
-    static const std::string tokenErrorMessage = "unrecognized token: ";
+    // A single pass over JSON text in memory. Nothing is copied: keys are compared in place
+    // and numbers are converted straight out of the buffer
+    class JsonReader {
+    public:
+        // A string pointing into the buffer (escapes are left as they are)
+        struct Key {
+            const char* data;
+            size_t      size;
 
-    static Light* light = NULL;
-    static Thing* thing = NULL;
+            bool operator==( const char* literal ) const { return !strncmp( data, literal, size ) && !literal[size]; }
+            std::string str() const { return std::string( data, size ); }
+        };
 
-    // Read and parse scene description
-    Camera* parseScene( std::istream& is )
-    {
-        Scene*  scene      = new Scene;
-        Camera* camera     = new Camera( scene );
-        bool sceneDefined  = false;
-        bool cameraDefined = false;
+        JsonReader( const char* begin, const char* end )
+            : begin( begin )
+            , pos( begin )
+            , end( end )
+        { }
 
-        int jsonDepth = 0;
-        while( !is.eof() )
+        bool atEnd() { skipWhitespace(); return pos == end; }
+        char peek()  { skipWhitespace(); return pos == end ? '\0' : *pos; }
+        bool accept( char c ) { if ( peek() != c ) return false; ++pos; return true; }
+        void expect( char c ) { if ( !accept(c) ) fail( std::string("expected '") + c + "'" ); }
+
+        // Call this in a loop after the opening bracket or brace of a list: it consumes the separating comma
+        // and returns false at the closing one. Stray commas are tolerated
+        bool next( char close )
         {
-            std::string token;
-            is >> std::ws >> token;
-            if     ( token == "{"           )
-            {
-                if ( ++jsonDepth == 2 )
-                    std::cerr << "parseScene: warning: Scene and Camera should be defined in the top level JSON object" << std::endl;
-            }
-            else if( token == "}"           )
-            {
-                if ( --jsonDepth < 0 )
-                    std::cerr << "parseScene: warning: ignoring unexpected '}' character in scene file" << std::endl;
-            }
-            else if( token == "\"camera\":" )
-            {
-                if ( cameraDefined )
-                    throw std::string( "the scene file has multiple Cameras defined; please specify a single Camera instead" );
-                if ( modeFlags.verbose )
-                    std::cerr << "parseScene: reading Camera from input scene description... ";
-                is >> *camera;
-                cameraDefined = true;
-                if ( modeFlags.verbose )
-                    std::cerr << "OK." << std::endl;
-            }
-            else if( token == "\"scene\":"  )
-            {
-                if ( sceneDefined )
-                    throw std::string( "the scene file has multiple Scenes defined; please specify a single Scene instead" );
-                is >> *scene;
-                sceneDefined = true;
-            }
-            else if( token == ","           )
-            {
-            }
-            else if( token.empty()          )
-            {
-                // The file had some trailing whitespace, but we've reached the end
-                assert( is.eof() );
-                break;
-            }
-            else
-                throw std::string( "unrecognized token in scene file: '" + token + "'" );
+            accept( ',' );
+            if ( accept(close) )
+                return false;
+            if ( atEnd() )
+                fail( std::string("missing '") + close + "'" );
+            return true;
         }
-        if( !camera )
-            throw std::string( "no Camera defined in scene file" );
-        if( !scene )
-            throw std::string( "no Scene defined in scene file" );
-        return camera;
+
+        Key    readString();
+        Key    readKey() { const Key key = readString(); expect( ':' ); return key; }
+        double readNumber();
+        int    readInt();
+        bool   readBool();
+        Vector readVector();
+
+        void fail( const std::string& message ) const; // Throws the message with the line number
+
+    private:
+        void skipWhitespace()
+        {
+            while ( pos != end && (' ' == *pos || '\n' == *pos || '\t' == *pos || '\r' == *pos) )
+                ++pos;
+        }
+
+        const char* const begin;
+        const char*       pos;
+        const char* const end;
+    };
+
+    JsonReader::Key JsonReader::readString()
+    {
+        expect( '"' );
+        Key key = { pos, 0 };
+        while ( pos != end && '"' != *pos )
+            pos += ( '\\' == *pos && pos + 1 != end ) ? 2 : 1;
+        if ( pos == end )
+            fail( "unterminated string" );
+        key.size = pos++ - key.data;
+        return key;
     }
 
-    std::istream& operator>>( std::istream& is, Triplet& triplet )
+    double JsonReader::readNumber()
     {
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '[') >> triplet.x;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> triplet.y;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> triplet.z;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), ']');
-        return is;
+        skipWhitespace();
+        double value;
+        const char* const after = scanNumber( pos, end, value );
+        if ( !after )
+            fail( "expected a number" );
+        pos = after;
+        return value;
     }
 
-    // Read Camera parameters from character stream
-    std::istream& operator>>( std::istream& is, Camera& camera )
+    int JsonReader::readInt()
     {
-        if ( camera.pixels )
-        {
-            // Free pixel table
-            for ( int i = 0; i < camera.screen.gridheight; ++i )
-                delete[] camera.pixels[i];
-            delete[] camera.pixels;
-        }
-        if ( camera.skyMask )
+        const double value = readNumber();
+        // Converting anything out of range (NaN and infinities too) to an int would be undefined
+        if ( !(INT_MIN <= value && value <= INT_MAX) || value != (int)value )
+            fail( "expected an integer" );
+        return value;
+    }
+
+    bool JsonReader::readBool()
+    {
+        skipWhitespace();
+        if ( 4 <= end - pos && !strncmp( pos, "true", 4 ) )
         {
-            // Free skyMask array
-            for ( int i = 0; i < camera.screen.gridheight; ++i )
-                delete[] camera.skyMask[i];
-            delete[] camera.skyMask;
+            pos += 4;
+            return true;
         }
-        bool viewpointDefined      = false;
-        bool screenDefined         = false;
-        bool gridResolutionDefined = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        if ( 5 <= end - pos && !strncmp( pos, "false", 5 ) )
         {
-            if      ( token == "\"viewpoint\":"      )
-            {
-                if ( viewpointDefined ) throw std::string("multiple definitions of \"viewpoint\"");
-                viewpointDefined = true;
-                is >> camera.viewpoint;
-            }
-            else if ( token == "\"screen\":"         )
-            {
-                if ( screenDefined ) throw std::string("multiple definitions of \"screen\"");
-                screenDefined = true;
-                is.ignore(std::numeric_limits< std::streamsize >::max(), '[') >> camera.screen.window[0];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> camera.screen.window[1];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> camera.screen.window[2];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> camera.screen.window[3];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ']');
-            }
-            else if ( token == "\"gridresolution\":" )
-            {
-                if ( gridResolutionDefined ) throw std::string("multiple definitions of \"gridresolution\"");
-                gridResolutionDefined = true;
-                is.ignore(std::numeric_limits< std::streamsize >::max(), '[') >> camera.screen.gridwidth;
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> camera.screen.gridheight;
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ']');
-            }
-            else if ( token == ","                   )
-            {
-            }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            pos += 5;
+            return false;
         }
-        // Allocate new pixel table
-        camera.pixels = new RGB*[camera.screen.gridheight];
-        for ( int i = 0; i < camera.screen.gridheight; ++i )
-            camera.pixels[i] = new RGB[camera.screen.gridwidth];
-        // Allocate new skyMask array
-        camera.skyMask = new double*[camera.screen.gridheight];
-        for ( int i = 0; i < camera.screen.gridheight; ++i )
-            camera.skyMask[i] = new double[camera.screen.gridwidth];
-        return is;
+        fail( "expected true or false" );
+        return false;
+    }
+
+    Vector JsonReader::readVector()
+    {
+        expect( '[' );
+        Vector vector;
+        vector.x = readNumber();
+        expect( ',' );
+        vector.y = readNumber();
+        expect( ',' );
+        vector.z = readNumber();
+        expect( ']' );
+        return vector;
     }
 
-    std::istream& operator>>( std::istream& is, Material::Character& character )
+    void JsonReader::fail( const std::string& message ) const
     {
-        double diffuse;
-        double metallic = 0;
-        double reflecting;
-        double refractive;
-        bool   diffuseDefined    = false;
-        bool   metallicDefined   = false;
-        bool   reflectingDefined = false;
-        bool   refractiveDefined = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        int line = 1;
+        for ( const char* c = begin; c != pos; ++c )
+            line += '\n' == *c;
+        std::stringstream ss;
+        ss << "line " << line << ": " << message;
+        throw ss.str();
+    }
+
+    // Throw if a key shows up twice in the same object. Each key gets a bit of 'defined'
+    static void define( JsonReader& reader, unsigned int& defined, unsigned int bit, const JsonReader::Key& key )
+    {
+        if ( defined & bit )
+            reader.fail( "multiple definitions of \"" + key.str() + "\"" );
+        defined |= bit;
+    }
+
+    static RGB readColor( JsonReader& reader )
+    {
+        const Vector color = reader.readVector();
+        if ( color.x < 0 || 1 < color.x || color.y < 0 || 1 < color.y || color.z < 0 || 1 < color.z )
+            reader.fail( "color components must be between 0 and 1" );
+        return RGB( color.x, color.y, color.z );
+    }
+
+    static Material readMaterial( JsonReader& reader )
+    {
+        enum { CHARACTER = 1, COLOR = 2, REFRACTIVEINDEX = 4, DIFFUSE = 8, METALLIC = 16, REFLECTING = 32, REFRACTIVE = 64 };
+        unsigned int defined = 0;
+        double character[4] = { 0, 0, 0, 0 };
+        RGB    color;
+        double refractiveIndex = 1;
+        JsonReader::Key key;
+        reader.expect( '{' );
+        while ( reader.next('}') )
         {
-            if      ( token == "\"diffuse\":"    )
-            {
-                if ( diffuseDefined ) throw std::string("multiple definitions of \"diffuse\"");
-                diffuseDefined = true;
-                is >> diffuse;
-            }
-            else if ( token == "\"metallic\":" )
-            {
-                if ( reflectingDefined ) throw std::string("multiple definitions of \"metallic\"");
-                metallicDefined = true;
-                is >> metallic;
-            }
-            else if ( token == "\"reflecting\":" )
-            {
-                if ( reflectingDefined ) throw std::string("multiple definitions of \"reflecting\"");
-                reflectingDefined = true;
-                is >> reflecting;
-            }
-            else if ( token == "\"refractive\":" )
-            {
-                if ( refractiveDefined ) throw std::string("multiple definitions of \"refractive\"");
-                refractiveDefined = true;
-                is >> refractive;
-            }
-            else if ( token == ","               )
+            key = reader.readKey();
+            if      ( key == "character"       )
             {
+                define( reader, defined, CHARACTER, key );
+                reader.expect( '{' );
+                while ( reader.next('}') )
+                {
+                    key = reader.readKey();
+                    if      ( key == "diffuse"    ) { define( reader, defined, DIFFUSE,    key ); character[0] = reader.readNumber(); }
+                    else if ( key == "metallic"   ) { define( reader, defined, METALLIC,   key ); character[1] = reader.readNumber(); }
+                    else if ( key == "reflecting" ) { define( reader, defined, REFLECTING, key ); character[2] = reader.readNumber(); }
+                    else if ( key == "refractive" ) { define( reader, defined, REFRACTIVE, key ); character[3] = reader.readNumber(); }
+                    else reader.fail( "unrecognized key \"" + key.str() + "\"" );
+                }
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            else if ( key == "color"           ) { define( reader, defined, COLOR,           key ); color = readColor( reader ); }
+            else if ( key == "refractiveindex" ) { define( reader, defined, REFRACTIVEINDEX, key ); refractiveIndex = reader.readNumber(); }
+            else reader.fail( "unrecognized key \"" + key.str() + "\"" );
         }
-        if ( !diffuseDefined    ) throw std::string("\"diffuse\" undefined");
-        if ( !metallicDefined   ) throw std::string("\"metallic\" undefined");
-        if ( !reflectingDefined ) throw std::string("\"reflecting\" undefined");
-        if ( !refractiveDefined ) throw std::string("\"refractive\" undefined");
-        character = Material::Character( diffuse, metallic, reflecting, refractive );
-        return is;
+        if ( !(defined & CHARACTER)  ) reader.fail( "\"character\" undefined" );
+        if ( !(defined & COLOR)      ) reader.fail( "\"color\" undefined" );
+        if ( !(defined & DIFFUSE)    ) reader.fail( "\"diffuse\" undefined" );
+        if ( !(defined & METALLIC)   ) reader.fail( "\"metallic\" undefined" );
+        if ( !(defined & REFLECTING) ) reader.fail( "\"reflecting\" undefined" );
+        if ( !(defined & REFRACTIVE) ) reader.fail( "\"refractive\" undefined" );
+        for ( int i = 0; i < 4; ++i )
+            if ( character[i] < 0 || 1 < character[i] )
+                reader.fail( "the character of a material must be made up of ratios between 0 and 1" );
+        if ( !equal( character[0] + character[1] + character[2] + character[3], 1.0 ) )
+            reader.fail( "the character of a material must add up to 1" );
+        if ( refractiveIndex <= 0 )
+            reader.fail( "\"refractiveindex\" must be positive" );
+        Material material( character[0], character[1], character[2], character[3], color );
+        material.setRefractiveIndex( refractiveIndex ); // Metals are given below 1, unlike what the constructor allows
+        return material;
     }
 
-    std::istream& operator>>( std::istream& is, Material& material )
+    // The properties that a Light or a Thing may have, either in its own list or in any of its parts
+    static bool readProperty( JsonReader& reader, const JsonReader::Key& key, Light* light, Thing* thing )
     {
-        bool characterDefined       = false;
-        bool colorDefined           = false;
-        bool refractiveIndexDefined = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        Object* const object = light ? (Object*)light : (Object*)thing;
+        if      ( key == "background" )
+            object->setBackground( reader.readBool() );
+        else if ( key == "backculled" )
+            object->setBackCulled( reader.readBool() );
+        else if ( key == "emission" && light )
+            light->setEmission( reader.readVector() );
+        else if ( key == "material" && thing )
+            thing->setMaterial( readMaterial(reader) );
+        else
+            return false;
+        return true;
+    }
+
+    enum PartKind { POINT, SPHERE, PLANE, TRIANGLE };
+
+    // Read the body of a single part into either 'light' or 'thing'
+    static void readPart( JsonReader& reader, PartKind kind, Light* light, Thing* thing )
+    {
+        enum { GEOMETRY = 1, RADIUS = 2 };
+        unsigned int defined = 0;
+        Vector points[3];
+        double scalar = 0; // The radius of a sphere or the offset of a plane
+        const char* const geometryKeys[] = { "point", "center", "normal", "points" };
+        const char* const scalarKeys  [] = { NULL,    "radius", "offset", NULL     };
+        JsonReader::Key key;
+        reader.expect( '{' );
+        while ( reader.next('}') )
         {
-            if      ( token == "\"character\":"       )
+            key = reader.readKey();
+            if      ( key == geometryKeys[kind] )
             {
-                if ( characterDefined ) throw std::string("multiple definitions of \"character\"");
-                characterDefined = true;
-                is >> material.character;
+                define( reader, defined, GEOMETRY, key );
+                if ( TRIANGLE == kind )
+                {
+                    reader.expect( '[' );
+                    for ( int i = 0; i < 3; ++i )
+                    {
+                        if ( 0 < i )
+                            reader.expect( ',' );
+                        points[i] = reader.readVector();
+                    }
+                    reader.expect( ']' );
+                }
+                else
+                    points[0] = reader.readVector();
             }
-            else if ( token == "\"color\":"           )
+            else if ( scalarKeys[kind] && key == scalarKeys[kind] )
             {
-                if ( colorDefined ) throw std::string("multiple definitions of \"color\"");
-                colorDefined = true;
-                is >> material.color;
+                define( reader, defined, RADIUS, key );
+                scalar = reader.readNumber();
             }
-            else if ( token == "\"refractiveindex\":" )
+            else if ( !readProperty( reader, key, light, thing ) )
+                reader.fail( "unrecognized key \"" + key.str() + "\"" );
+        }
+        if ( !(defined & GEOMETRY) )
+            reader.fail( std::string("\"") + geometryKeys[kind] + "\" undefined" );
+        if ( scalarKeys[kind] && !(defined & RADIUS) )
+            reader.fail( std::string("\"") + scalarKeys[kind] + "\" undefined" );
+        if ( light )
+        {
+            switch ( kind )
             {
-                if ( refractiveIndexDefined ) throw std::string("multiple definitions of \"refractiveindex\"");
-                refractiveIndexDefined = true;
-                is >> material.refractiveIndex;
+                case POINT:    light->push_back( new LightPoint   ( light, points[0] ) );                       break;
+                case SPHERE:   light->push_back( new LightSphere  ( light, points[0], scalar ) );               break;
+                case PLANE:    light->push_back( new LightPlane   ( light, points[0], scalar ) );               break;
+                case TRIANGLE: light->push_back( new LightTriangle( light, points[0], points[1], points[2] ) ); break;
             }
-            else if ( token == ","                    )
+        }
+        else
+        {
+            switch ( kind )
             {
+                case POINT:    assert( false );                                                        break;
+                case SPHERE:   thing->push_back( new Sphere  ( thing, points[0], scalar ) );               break;
+                case PLANE:    thing->push_back( new Plane   ( thing, points[0], scalar ) );               break;
+                case TRIANGLE: thing->push_back( new Triangle( thing, points[0], points[1], points[2] ) ); break;
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
         }
-        if ( !characterDefined ) throw std::string("\"diffuse\" undefined");
-        if ( !colorDefined     ) throw std::string("\"reflecting\" undefined");
-        return is;
     }
 
-    std::istream& operator>>( std::istream& is, LightPoint& lightPoint )
+    // Read the body of a "mesh" part into 'thing': an array of "vertices" and the three vertex indices of each of its "faces",
+    // or the name of an OBJ or PLY "file" to import them from (relative to 'directory' unless it's an absolute path)
+    static void readMesh( JsonReader& reader, Thing* thing, const std::string& directory )
     {
-        bool emissionDefined = false;
-        bool pointDefined    = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        enum { VERTICES = 1, FACES = 2, FILENAME = 4 };
+        unsigned int defined = 0;
+        std::vector< Vector >       vertices;
+        std::vector< unsigned int > indices;
+        JsonReader::Key key;
+        reader.expect( '{' );
+        while ( reader.next('}') )
         {
-            if      ( token == "\"emission\":" )
+            key = reader.readKey();
+            if      ( key == "vertices" )
             {
-                if ( emissionDefined ) throw std::string("multiple definitions of \"emission\"");
-                emissionDefined = true;
-                is >> light->emission;
+                define( reader, defined, VERTICES, key );
+                reader.expect( '[' );
+                while ( reader.next(']') )
+                    vertices.push_back( reader.readVector() );
             }
-            else if ( token == "\"point\":"    )
+            else if ( key == "faces" )
             {
-                if ( pointDefined ) throw std::string("multiple definitions of \"point\"");
-                pointDefined = true;
-                is >> lightPoint.point;
+                define( reader, defined, FACES, key );
+                reader.expect( '[' );
+                while ( reader.next(']') )
+                {
+                    reader.expect( '[' );
+                    for ( int i = 0; i < 3; ++i )
+                    {
+                        if ( 0 < i )
+                            reader.expect( ',' );
+                        const int index = reader.readInt();
+                        if ( index < 0 )
+                            reader.fail( "vertex indices must not be negative" );
+                        indices.push_back( index );
+                    }
+                    reader.expect( ']' );
+                }
             }
-            else if ( token == ","             )
+            else if ( key == "file" )
             {
+                define( reader, defined, FILENAME, key );
+                const std::string filename = reader.readString().str();
+                try {
+                    parseMeshFile( ('/' == filename[0] ? filename : directory + filename).c_str(), vertices, indices );
+                }
+                catch( const std::string& message ) {
+                    reader.fail( message );
+                }
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            else if ( !readProperty( reader, key, NULL, thing ) )
+                reader.fail( "unrecognized key \"" + key.str() + "\"" );
         }
-        if ( !pointDefined ) throw std::string("\"point\" undefined");
-        return is;
+        if ( defined & FILENAME )
+        {
+            if ( defined & (VERTICES | FACES) )
+                reader.fail( "a mesh is given either by \"file\" or by \"vertices\" and \"faces\", not both" );
+        }
+        else
+        {
+            if ( !(defined & VERTICES) ) reader.fail( "\"vertices\" undefined" );
+            if ( !(defined & FACES)    ) reader.fail( "\"faces\" undefined" );
+        }
+        for ( std::vector< unsigned int >::const_iterator index = indices.begin(); index != indices.end(); index++ )
+            if ( vertices.size() <= *index )
+                reader.fail( "a face of the mesh refers to a vertex that doesn't exist" );
+        thing->push_back( new Mesh( thing, vertices, indices ) );
     }
 
-    std::istream& operator>>( std::istream& is, LightSphere& lightSphere )
+    // Which kind of part a key stands for, and whether it's a light part
+    static bool partKind( const JsonReader::Key& key, PartKind& kind, bool& lightPart )
     {
-        bool emissionDefined   = false;
-        bool backgroundDefined = false;
-        bool backCulledDefined = false;
-        bool centerDefined     = false;
-        bool radiusDefined     = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        static const char* const names[] = { "lightpoint", "lightsphere", "lightplane", "lighttriangle", NULL, "sphere", "plane", "triangle" };
+        for ( int i = 0; i < 8; ++i )
         {
-            if      ( token == "\"emission\":"   )
-            {
-                if ( emissionDefined ) throw std::string("multiple definitions of \"emission\"");
-                emissionDefined = true;
-                is >> light->emission;
-            }
-            else if ( token == "\"background\":" )
-            {
-                if ( backgroundDefined ) throw std::string("multiple definitions of \"background\"");
-                backgroundDefined = true;
-                is >> light->background;
-            }
-            else if ( token == "\"backculled\":" )
-            {
-                if ( backCulledDefined ) throw std::string("multiple definitions of \"backculled\"");
-                backCulledDefined = true;
-                is >> light->backCulled;
-            }
-            else if ( token == "\"center\":"     )
-            {
-                if ( centerDefined ) throw std::string("multiple definitions of \"center\"");
-                centerDefined = true;
-                is >> lightSphere.center;
-            }
-            else if ( token == "\"radius\":"     )
-            {
-                if ( radiusDefined ) throw std::string("multiple definitions of \"radius\"");
-                radiusDefined = true;
-                is >> lightSphere.radius;
-            }
-            else if ( token == ","               )
+            if ( names[i] && key == names[i] )
             {
+                kind      = (PartKind)(i % 4);
+                lightPart = i < 4;
+                return true;
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
         }
-        if ( !centerDefined ) throw std::string("\"center\" undefined");
-        if ( !radiusDefined ) throw std::string("\"radius\" undefined");
-        return is;
+        return false;
     }
 
-    std::istream& operator>>( std::istream& is, LightPlane& lightPlane )
+    // The list of properties and parts after "light" or "thing"
+    static void readCompound( JsonReader& reader, Light* light, Thing* thing, const std::string& directory )
     {
-        bool emissionDefined   = false;
-        bool backgroundDefined = false;
-        bool backCulledDefined = false;
-        bool normalDefined     = false;
-        bool offsetDefined     = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        JsonReader::Key key;
+        reader.expect( '[' );
+        while ( reader.next(']') )
         {
-            if      ( token == "\"emission\":"   )
-            {
-                if ( emissionDefined ) throw std::string("multiple definitions of \"emission\"");
-                emissionDefined = true;
-                is >> light->emission;
-            }
-            else if ( token == "\"background\":" )
-            {
-                if ( backgroundDefined ) throw std::string("multiple definitions of \"background\"");
-                backgroundDefined = true;
-                is >> light->background;
-            }
-            else if ( token == "\"backculled\":" )
-            {
-                if ( backCulledDefined ) throw std::string("multiple definitions of \"backculled\"");
-                backCulledDefined = true;
-                is >> light->backCulled;
-            }
-            else if ( token == "\"normal\":"     )
-            {
-                if ( normalDefined ) throw std::string("multiple definitions of \"normal\"");
-                normalDefined = true;
-                is >> lightPlane.normal;
-            }
-            else if ( token == "\"offset\":"     )
-            {
-                if ( offsetDefined ) throw std::string("multiple definitions of \"offset\"");
-                offsetDefined = true;
-                is >> lightPlane.offset;
-            }
-            else if ( token == ","               )
-            {
-            }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            if ( '{' != reader.peek() )
+            {
+                key = reader.readKey();
+                if ( !readProperty( reader, key, light, thing ) )
+                    reader.fail( "unrecognized key \"" + key.str() + "\"" );
+                continue;
+            }
+            reader.expect( '{' );
+            key = reader.readKey();
+            PartKind kind      = POINT;
+            bool     lightPart = false;
+            if ( key == "mesh" )
+            {
+                if ( light )
+                    reader.fail( "a Light cannot contain thing parts" );
+                readMesh( reader, thing, directory );
+                reader.expect( '}' );
+                continue;
+            }
+            if ( !partKind( key, kind, lightPart ) )
+                reader.fail( "unrecognized part \"" + key.str() + "\"" );
+            if ( lightPart != (NULL != light) )
+                reader.fail( light ? "a Light cannot contain thing parts" : "a Thing cannot contain light parts" );
+            readPart( reader, kind, light, thing );
+            reader.expect( '}' );
         }
-        if ( !normalDefined ) throw std::string("\"normal\" undefined");
-        if ( !offsetDefined ) throw std::string("\"offset\" undefined");
-        return is;
     }
 
-    std::istream& operator>>( std::istream& is, LightTriangle& lightTriangle )
+    // The body of an "instance": a copy of the Thing named after "of", rotated about the world axes by
+    // a list of { "axis": "X", "Y" or "Z", "degrees": angle } in "rotate" first, then moved by "translate".
+    // The copy may be given a material and the rest of the properties of its own too
+    static void readInstance( JsonReader& reader, Scene* scene, const std::map< std::string, const Thing* >& names )
     {
-        bool emissionDefined   = false;
-        bool backgroundDefined = false;
-        bool backCulledDefined = false;
-        bool pointsDefined     = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        enum { OF = 1, ROTATE = 2, TRANSLATE = 4 };
+        unsigned int defined = 0;
+        std::vector< std::pair< WorldAxis, double > > rotations;
+        Vector translation = Vector::Zero;
+        Thing* thing = NULL;
+        JsonReader::Key key;
+        reader.expect( '{' );
+        while ( reader.next('}') )
         {
-            if      ( token == "\"emission\":"   )
+            key = reader.readKey();
+            if      ( key == "of" )
             {
-                if ( emissionDefined ) throw std::string("multiple definitions of \"emission\"");
-                emissionDefined = true;
-                is >> light->emission;
+                define( reader, defined, OF, key );
+                const std::map< std::string, const Thing* >::const_iterator prototype = names.find( reader.readString().str() );
+                if ( prototype == names.end() )
+                    reader.fail( "\"of\" must be the name of a Thing defined earlier" );
+                thing = prototype->second->instantiate();
+                scene->add( thing );
             }
-            else if ( token == "\"background\":" )
+            else if ( key == "rotate" )
             {
-                if ( backgroundDefined ) throw std::string("multiple definitions of \"background\"");
-                backgroundDefined = true;
-                is >> light->background;
-            }
-            else if ( token == "\"backculled\":" )
-            {
-                if ( backCulledDefined ) throw std::string("multiple definitions of \"backculled\"");
-                backCulledDefined = true;
-                is >> light->backCulled;
-            }
-            else if ( token == "\"points\":"     )
-            {
-                if ( pointsDefined ) throw std::string("multiple definitions of \"points\"");
-                pointsDefined = true;
-                is.ignore(std::numeric_limits< std::streamsize >::max(), '[') >> lightTriangle.points[0];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> lightTriangle.points[1];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> lightTriangle.points[2];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ']');
+                define( reader, defined, ROTATE, key );
+                reader.expect( '[' );
+                while ( reader.next(']') )
+                {
+                    unsigned int rotationDefined = 0;
+                    WorldAxis axis    = INVALID;
+                    double    degrees = 0;
+                    reader.expect( '{' );
+                    while ( reader.next('}') )
+                    {
+                        key = reader.readKey();
+                        if      ( key == "axis" )
+                        {
+                            define( reader, rotationDefined, 1, key );
+                            const JsonReader::Key name = reader.readString();
+                            if      ( name == "X" ) axis = AXIS_X;
+                            else if ( name == "Y" ) axis = AXIS_Y;
+                            else if ( name == "Z" ) axis = AXIS_Z;
+                            else reader.fail( "\"axis\" must be \"X\", \"Y\" or \"Z\"" );
+                        }
+                        else if ( key == "degrees" )
+                        {
+                            define( reader, rotationDefined, 2, key );
+                            degrees = reader.readNumber();
+                        }
+                        else reader.fail( "unrecognized key \"" + key.str() + "\"" );
+                    }
+                    if ( INVALID == axis )
+                        reader.fail( "\"axis\" undefined" );
+                    rotations.push_back( std::make_pair( axis, degrees * PI / 180 ) );
+                }
             }
-            else if ( token == ","               )
+            else if ( key == "translate" )
             {
+                define( reader, defined, TRANSLATE, key );
+                translation = reader.readVector();
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            else if ( !thing )
+                reader.fail( "\"of\" must come first in an instance" );
+            else if ( !readProperty( reader, key, NULL, thing ) )
+                reader.fail( "unrecognized key \"" + key.str() + "\"" );
         }
-        if ( !pointsDefined ) throw std::string("\"points\" undefined");
-        return is;
+        if ( !thing )
+            reader.fail( "\"of\" undefined" );
+        for ( std::vector< std::pair< WorldAxis, double > >::const_iterator rotation = rotations.begin(); rotation != rotations.end(); rotation++ )
+            thing->move( rotation->second, rotation->first );
+        thing->move( translation );
     }
 
-    std::istream& operator>>( std::istream& is, Sphere& sphere )
+    static void readScene( JsonReader& reader, Scene* scene, const std::string& directory )
     {
-        bool materialDefined   = false;
-        bool backgroundDefined = false;
-        bool backCulledDefined = false;
-        bool centerDefined     = false;
-        bool radiusDefined     = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        bool skyDefined = false;
+        int  objectNumber = 0;
+        std::map< std::string, const Thing* > names; // Things that may be instanced later on
+        JsonReader::Key key;
+        reader.expect( '[' );
+        while ( reader.next(']') )
         {
-            if      ( token == "\"material\":"   )
-            {
-                if ( materialDefined ) throw std::string("multiple definitions of \"material\"");
-                materialDefined = true;
-                is >> thing->material;
-            }
-            else if ( token == "\"background\":" )
-            {
-                if ( backgroundDefined ) throw std::string("multiple definitions of \"background\"");
-                backgroundDefined = true;
-                is >> thing->background;
-            }
-            else if ( token == "\"backculled\":" )
-            {
-                if ( backCulledDefined ) throw std::string("multiple definitions of \"backculled\"");
-                backCulledDefined = true;
-                is >> thing->backCulled;
-            }
-            else if ( token == "\"center\":"     )
-            {
-                if ( centerDefined ) throw std::string("multiple definitions of \"center\"");
-                centerDefined = true;
-                is >> sphere.center;
+            reader.expect( '{' );
+            key = reader.readKey();
+            std::string name;
+            if ( key == "name" )
+            {
+                // An object may be named before its kind is given, so it can be instanced later on
+                name = reader.readString().str();
+                if ( names.count(name) )
+                    reader.fail( "there is another Thing named \"" + name + "\" already" );
+                reader.expect( ',' );
+                key = reader.readKey();
+            }
+            const size_t thingCount = scene->thingsEnd() - scene->thingsBegin();
+            PartKind kind      = POINT;
+            bool     lightPart = false;
+            if      ( key == "light" )
+            {
+                Light* light = new Light( scene );
+                scene->add( light );
+                readCompound( reader, light, NULL, directory );
+            }
+            else if ( key == "thing" )
+            {
+                Thing* thing = new Thing( scene );
+                scene->add( thing );
+                readCompound( reader, NULL, thing, directory );
+            }
+            else if ( key == "mesh" )
+            {
+                Thing* thing = new Thing( scene );
+                scene->add( thing );
+                readMesh( reader, thing, directory );
+            }
+            else if ( key == "instance" )
+                readInstance( reader, scene, names );
+            else if ( key == "sky" )
+            {
+                if ( skyDefined )
+                    reader.fail( "the scene file has multiple Skies defined; please specify at most one Sky instead" );
+                skyDefined = true;
+                reader.expect( '{' );
+                bool colorDefined = false;
+                while ( reader.next('}') )
+                {
+                    key = reader.readKey();
+                    if ( !(key == "color") )
+                        reader.fail( "unrecognized key \"" + key.str() + "\"" );
+                    if ( colorDefined )
+                        reader.fail( "multiple definitions of \"color\"" );
+                    colorDefined = true;
+                    scene->setSky( readColor(reader) );
+                }
+                if ( !colorDefined )
+                    reader.fail( "\"color\" undefined" );
             }
-            else if ( token == "\"radius\":"     )
+            else if ( partKind( key, kind, lightPart ) )
             {
-                if ( radiusDefined ) throw std::string("multiple definitions of \"radius\"");
-                radiusDefined = true;
-                is >> sphere.radius;
+                // A single part makes up an object on its own
+                if ( lightPart )
+                {
+                    Light* light = new Light( scene );
+                    scene->add( light );
+                    readPart( reader, kind, light, NULL );
+                }
+                else
+                {
+                    Thing* thing = new Thing( scene );
+                    scene->add( thing );
+                    readPart( reader, kind, NULL, thing );
+                }
             }
-            else if ( token == ","               )
+            else
+                reader.fail( "unrecognized object \"" + key.str() + "\"" );
+            if ( !name.empty() )
             {
+                if ( thingCount == (size_t)(scene->thingsEnd() - scene->thingsBegin()) )
+                    reader.fail( "only Things can be named" );
+                names[name] = *(scene->thingsEnd() - 1);
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            reader.expect( '}' );
+            ++objectNumber;
         }
-        if ( !centerDefined ) throw std::string("\"center\" undefined");
-        if ( !radiusDefined ) throw std::string("\"radius\" undefined");
-        return is;
+        if ( modeFlags.verbose )
+            std::cerr << "parseScene: read " << objectNumber << " objects from input scene description." << std::endl;
     }
 
-    std::istream& operator>>( std::istream& is, Plane& plane )
+    struct CameraDescription {
+        Vector viewpoint;
+        Vector window[4];
+        int    gridwidth;
+        int    gridheight;
+    };
+
+    static CameraDescription readCamera( JsonReader& reader )
     {
-        bool materialDefined   = false;
-        bool backgroundDefined = false;
-        bool backCulledDefined = false;
-        bool normalDefined     = false;
-        bool offsetDefined     = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        enum { VIEWPOINT = 1, SCREEN = 2, GRIDRESOLUTION = 4 };
+        unsigned int defined = 0;
+        CameraDescription camera;
+        JsonReader::Key key;
+        reader.expect( '{' );
+        while ( reader.next('}') )
         {
-            if      ( token == "\"material\":"   )
+            key = reader.readKey();
+            if      ( key == "viewpoint"      )
             {
-                if ( materialDefined ) throw std::string("multiple definitions of \"material\"");
-                materialDefined = true;
-                is >> thing->material;
+                define( reader, defined, VIEWPOINT, key );
+                camera.viewpoint = reader.readVector();
             }
-            else if ( token == "\"background\":" )
+            else if ( key == "screen"         )
             {
-                if ( backgroundDefined ) throw std::string("multiple definitions of \"background\"");
-                backgroundDefined = true;
-                is >> thing->background;
-            }
-            else if ( token == "\"backculled\":" )
-            {
-                if ( backCulledDefined ) throw std::string("multiple definitions of \"backculled\"");
-                backCulledDefined = true;
-                is >> thing->backCulled;
-            }
-            else if ( token == "\"normal\":"     )
-            {
-                if ( normalDefined ) throw std::string("multiple definitions of \"normal\"");
-                normalDefined = true;
-                is >> plane.normal;
-            }
-            else if ( token == "\"offset\":"     )
-            {
-                if ( offsetDefined ) throw std::string("multiple definitions of \"offset\"");
-                offsetDefined = true;
-                is >> plane.offset;
+                define( reader, defined, SCREEN, key );
+                reader.expect( '[' );
+                for ( int i = 0; i < 4; ++i )
+                {
+                    if ( 0 < i )
+                        reader.expect( ',' );
+                    camera.window[i] = reader.readVector();
+                }
+                reader.expect( ']' );
             }
-            else if ( token == ","               )
+            else if ( key == "gridresolution" )
             {
+                define( reader, defined, GRIDRESOLUTION, key );
+                reader.expect( '[' );
+                camera.gridwidth  = reader.readInt();
+                reader.expect( ',' );
+                camera.gridheight = reader.readInt();
+                reader.expect( ']' );
+                if ( camera.gridwidth <= 0 || camera.gridheight <= 0 )
+                    reader.fail( "\"gridresolution\" must be positive" );
             }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            else reader.fail( "unrecognized key \"" + key.str() + "\"" );
         }
-        if ( !normalDefined ) throw std::string("\"normal\" undefined");
-        if ( !offsetDefined ) throw std::string("\"offset\" undefined");
-        return is;
+        if ( !(defined & VIEWPOINT)      ) reader.fail( "\"viewpoint\" undefined" );
+        if ( !(defined & SCREEN)         ) reader.fail( "\"screen\" undefined" );
+        if ( !(defined & GRIDRESOLUTION) ) reader.fail( "\"gridresolution\" undefined" );
+        return camera;
     }
 
-    std::istream& operator>>( std::istream& is, Triangle& triangle )
+    // Read and parse scene description
+    Camera* parseScene( const char* data, size_t size, const std::string& directory )
     {
-        bool materialDefined   = false;
-        bool backgroundDefined = false;
-        bool backCulledDefined = false;
-        bool pointsDefined     = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
-        {
-            if      ( token == "\"material\":"   )
-            {
-                if ( materialDefined ) throw std::string("multiple definitions of \"material\"");
-                materialDefined = true;
-                is >> thing->material;
-            }
-            else if ( token == "\"background\":" )
-            {
-                if ( backgroundDefined ) throw std::string("multiple definitions of \"background\"");
-                backgroundDefined = true;
-                is >> thing->background;
-            }
-            else if ( token == "\"backculled\":" )
-            {
-                if ( backCulledDefined ) throw std::string("multiple definitions of \"backculled\"");
-                backCulledDefined = true;
-                is >> thing->backCulled;
-            }
-            else if ( token == "\"points\":"     )
-            {
-                if ( pointsDefined ) throw std::string("multiple definitions of \"points\"");
-                pointsDefined = true;
-                is.ignore(std::numeric_limits< std::streamsize >::max(), '[') >> triangle.points[0];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> triangle.points[1];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> triangle.points[2];
-                is.ignore(std::numeric_limits< std::streamsize >::max(), ']');
-            }
-            else if ( token == ","               )
+        if ( isCompiledScene( data, size ) )
+            return loadCompiledScene( data, size );
+        JsonReader reader( data, data + size );
+        Scene* scene = new Scene;
+        CameraDescription camera;
+        bool sceneDefined  = false;
+        bool cameraDefined = false;
+        try {
+            JsonReader::Key key;
+            reader.expect( '{' );
+            while ( reader.next('}') )
             {
-            }
-            else throw tokenErrorMessage + token;
-            is >> token;
+                key = reader.readKey();
+                if      ( key == "camera" )
+                {
+                    if ( cameraDefined )
+                        reader.fail( "the scene file has multiple Cameras defined; please specify a single Camera instead" );
+                    if ( modeFlags.verbose )
+                        std::cerr << "parseScene: reading Camera from input scene description..." << std::endl;
+                    camera = readCamera( reader );
+                    cameraDefined = true;
+                }
+                else if ( key == "scene"  )
+                {
+                    if ( sceneDefined )
+                        reader.fail( "the scene file has multiple Scenes defined; please specify a single Scene instead" );
+                    readScene( reader, scene, directory );
+                    sceneDefined = true;
+                }
+                else
+                    reader.fail( "unrecognized key \"" + key.str() + "\" in scene file" );
+            }
+            if ( !reader.atEnd() )
+                reader.fail( "unexpected characters after the end of the scene description" );
+            if ( !cameraDefined )
+                throw std::string( "no Camera defined in scene file" );
+            if ( !sceneDefined )
+                throw std::string( "no Scene defined in scene file" );
         }
-        if ( !pointsDefined ) throw std::string("\"points\" undefined");
-        return is;
+        catch( const std::string& ) {
+            delete scene;
+            throw;
+        }
+        const Vector* window = camera.window;
+        return new Camera( scene, camera.viewpoint, window[0], window[1], window[2], window[3], camera.gridwidth, camera.gridheight );
+    }
+
+    Camera* parseScene( std::istream& is )
+    {
+        std::ostringstream buffer;
+        buffer << is.rdbuf();
+        const std::string text = buffer.str();
+        return parseScene( text.data(), text.size() );
     }
 
-    std::istream& operator>>( std::istream& is, Sky& sky )
+    Camera* parseSceneFile( const char* filename )
     {
-        bool colorDefined = false;
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '{');
-        std::string token;
-        is >> token;
-        while ( token[0] != '}' )
+        const char* const slash = strrchr( filename, '/' );
+        const std::string directory( filename, slash ? slash + 1 - filename : 0 );
+        const int fd = open( filename, O_RDONLY );
+        if ( -1 == fd )
+            return NULL;
+        struct stat info;
+        if ( -1 == fstat( fd, &info ) )
         {
-            if ( token == "\"color\":"   )
-            {
-                if ( colorDefined ) throw std::string("multiple definitions of \"color\"");
-                colorDefined = true;
-                is >> sky.color;
-            }
-            else throw tokenErrorMessage + token;
-            is >> token;
+            close( fd );
+            return NULL;
+        }
+        if ( !S_ISREG( info.st_mode ) || 0 == info.st_size )
+        {
+            // Pipes and the like cannot be mapped, read them through a stream instead
+            close( fd );
+            std::ifstream ifs( filename, std::ios::binary );
+            if ( !ifs.is_open() )
+                return NULL;
+            std::ostringstream buffer;
+            buffer << ifs.rdbuf();
+            const std::string text = buffer.str();
+            return parseScene( text.data(), text.size(), directory );
+        }
+        void* const data = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+        if ( MAP_FAILED == data )
+            return NULL;
+        madvise( data, info.st_size, MADV_SEQUENTIAL );
+        try {
+            Camera* const camera = parseScene( (const char*)data, info.st_size, directory );
+            munmap( data, info.st_size );
+            return camera;
+        }
+        catch( const std::string& ) {
+            munmap( data, info.st_size );
+            throw;
         }
-        if ( !colorDefined ) throw std::string("\"color\" undefined");
-        return is;
     }
 
-    // Read Scene description from character stream
-    std::istream& operator>>( std::istream& is, Scene& scene )
+    // The motions parser still reads Triplets from a stream
+    std::istream& operator>>( std::istream& is, Triplet& triplet )
     {
-        bool skyDefined = false;
-
-        int objectNumber = 0;
+        is.ignore(std::numeric_limits< std::streamsize >::max(), '[') >> triplet.x;
+        is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> triplet.y;
+        is.ignore(std::numeric_limits< std::streamsize >::max(), ',') >> triplet.z;
+        is.ignore(std::numeric_limits< std::streamsize >::max(), ']');
+        return is;
+    }
 
-        is.ignore(std::numeric_limits< std::streamsize >::max(), '[');
-        is >> std::boolalpha;
-        std::string token;
-        while ( token[0] != ']' || light || thing )
+    // Used for Camera overrides in render jobs: the object is cut out of the stream and parsed on its own
+    std::istream& operator>>( std::istream& is, Camera& camera )
+    {
+        std::string text;
+        int  depth    = 0;
+        bool inString = false;
+        char c;
+        is >> std::ws;
+        while ( is.get( c ) )
         {
-            is >> token;
-            try
-            {
-                if ( token == "{" || token == "}" || token == "}," )
-                {
-                    continue;
-                }
-                else if ( token == "\"light\":" )
-                {
-                    if ( light )
-                        throw std::string( "nested Lights are not allowed" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading Light from input scene description..." << std::endl;
-                    light = new Light( &scene );
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '[');
-                }
-                else if ( token == "\"thing\":" )
-                {
-                    if ( thing )
-                        throw std::string( "nested Things are not allowed" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading Thing from input scene description..." << std::endl;
-                    thing = new Thing( &scene );
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '[');
-                }
-                else if ( token == "\"background\":" )
-                {
-                    if      ( light )
-                        is >> light->background;
-                    else if ( thing )
-                        is >> thing->background;
-                    else
-                        throw std::string( "unexpected \"background\" token" );
-                }
-                else if ( token == "\"backculled\":" )
-                {
-                    if      ( light )
-                        is >> light->backCulled;
-                    else if ( thing )
-                        is >> thing->backCulled;
-                    else
-                        throw std::string( "unexpected \"backculled\" token" );
-                }
-                else if ( token == "\"emission\":" )
-                {
-                    if      ( light )
-                        is >> light->emission;
-                    else if ( thing )
-                        throw std::string( "unexpected \"emission\" token" );
-                    else
-                        throw std::string( "unexpected \"emission\" token" );
-                }
-                else if ( token == "\"material\":" )
-                {
-                    if      ( light )
-                        throw std::string( "unexpected \"material\" token" );
-                    else if ( thing )
-                        is >> thing->material;
-                    else
-                        throw std::string( "unexpected \"material\" token" );
-                }
-                else if ( token == "\"lightpoint\":" )
-                {
-                    if ( thing )
-                        throw std::string( "a Thing cannot contain light parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading LightPoint from input scene description... ";
-                    bool single = !light;
-                    if ( single )
-                        light = new Light( &scene );
-                    LightPoint* lightPoint = new LightPoint( light );
-                    is >> *lightPoint;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    light->push_back( lightPoint );
-                    if ( single )
-                    {
-                        scene.lights.push_back( light );
-                        light = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"lightsphere\":" )
-                {
-                    if ( thing )
-                        throw std::string( "a Thing cannot contain light parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading LightSphere from input scene description... ";
-                    bool single = !light;
-                    if ( single )
-                        light = new Light( &scene );
-                    LightSphere* lightSphere = new LightSphere( light );
-                    is >> *lightSphere;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    light->push_back( lightSphere );
-                    if ( single )
-                    {
-                        scene.lights.push_back( light );
-                        light = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"lightplane\":" )
-                {
-                    if ( thing )
-                        throw std::string( "a Thing cannot contain light parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading LightPlane from input scene description... ";
-                    bool single = !light;
-                    if ( single )
-                        light = new Light( &scene );
-                    LightPlane* lightPlane = new LightPlane( light );
-                    is >> *lightPlane;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    light->push_back( lightPlane );
-                    if ( single )
-                    {
-                        scene.lights.push_back( light );
-                        light = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"lighttriangle\":" )
-                {
-                    if ( thing )
-                        throw std::string( "a Thing cannot contain light parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading LightTriangle from input scene description... ";
-                    bool single = !light;
-                    if ( single )
-                        light = new Light( &scene );
-                    light = new Light( &scene );
-                    LightTriangle* lightTriangle = new LightTriangle( light );
-                    is >> *lightTriangle;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    light->push_back( lightTriangle );
-                    if ( single )
-                    {
-                        scene.lights.push_back( light );
-                        light = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"sphere\":" )
-                {
-                    if ( light )
-                        throw std::string( "a Light cannot contain thing parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading Sphere from input scene description... ";
-                    bool single = !thing;
-                    if ( single )
-                        thing = new Thing( &scene );
-                    Sphere* sphere = new Sphere( thing );
-                    is >> *sphere;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    thing->push_back( sphere );
-                    if ( single )
-                    {
-                        scene.things.push_back( thing );
-                        thing = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"plane\":" )
-                {
-                    if ( light )
-                        throw std::string( "a Light cannot contain thing parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading Plane from input scene description... ";
-                    bool single = !thing;
-                    if ( single )
-                        thing = new Thing( &scene );
-                    Plane* plane = new Plane( thing );
-                    is >> *plane;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    thing->push_back( plane );
-                    if ( single )
-                    {
-                        scene.things.push_back( thing );
-                        thing = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"triangle\":" )
-                {
-                    if ( light )
-                        throw std::string( "a Light cannot contain thing parts" );
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading Triangle from input scene description... ";
-                    bool single = !thing;
-                    if ( single )
-                        thing = new Thing( &scene );
-                    Triangle* triangle = new Triangle( thing );
-                    is >> *triangle;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    thing->push_back( triangle );
-                    if ( single )
-                    {
-                        scene.things.push_back( thing );
-                        thing = NULL;
-                    }
-                    ++objectNumber;
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "\"sky\":" )
-                {
-                    if ( skyDefined )
-                        throw std::string( "the scene file has multiple Skies defined; please specify at most one Sky instead" );
-                    skyDefined = true;
-                    if ( modeFlags.verbose )
-                        std::cerr << "parseScene: reading Sky from input scene description... ";
-                    is >> scene.sky;
-                    is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                    if ( modeFlags.verbose )
-                        std::cerr << "OK." << std::endl;
-                }
-                else if ( token == "]" )
-                {
-                    if      ( light )
-                    {
-                        scene.lights.push_back( light );
-                        light = NULL;
-                        ++objectNumber;
-                        is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                        token.clear();
-                        if ( modeFlags.verbose )
-                            std::cerr << "parseScene: end of Light." << std::endl;
-                    }
-                    else if ( thing )
-                    {
-                        scene.things.push_back( thing );
-                        thing = NULL;
-                        ++objectNumber;
-                        is.ignore(std::numeric_limits< std::streamsize >::max(), '}');
-                        token.clear();
-                        if ( modeFlags.verbose )
-                            std::cerr << "parseScene: end of Thing." << std::endl;
-                    }
-                    else
-                        throw std::string( "unexpected ']' token" );
-                }
-                else if ( token == "]," || token == "," )
-                {
-                }
-                else
-                    throw std::string( "unrecognized token in Scene description: " + token );
-            }
-            catch( std::string e )
-            {
-                // Propagate exception to main
-                std::stringstream ss;
-                ss << "in object #" << objectNumber << ": " << e;
-                throw ss.str();
-            }
+            text += c;
+            if ( inString )
+            {
+                if ( '\\' == c && is.get( c ) )
+                    text += c;
+                else if ( '"' == c )
+                    inString = false;
+            }
+            else if ( '"' == c )
+                inString = true;
+            else if ( '{' == c )
+                ++depth;
+            else if ( '}' == c && --depth <= 0 )
+                break;
         }
+        JsonReader reader( text.data(), text.data() + text.size() );
+        const CameraDescription description = readCamera( reader );
+        camera.viewpoint = description.viewpoint;
+        camera.screen    = Camera::Screen( description.window[0], description.window[1], description.window[2], description.window[3],
+                                           description.gridwidth, description.gridheight );
+        camera.allocate();
         return is;
     }
 
 }
-
@@ -23,13 +23,21 @@
 #ifndef SILENCE_PARSESCENE
 #define SILENCE_PARSESCENE
 
+#include <cstddef>
 #include <istream>
+#include <string>
 
 namespace Silence {
 
     class Camera;
 
+    // Compiled scenes (see compiledscene.h) are recognized and loaded as they are
     Camera* parseScene( std::istream& is );
+    // Parse a scene description that's already in memory, without copying it.
+    // Mesh files named in the scene are looked for in 'directory' (which should end in a slash) unless their path is absolute
+    Camera* parseScene( const char* data, size_t size, const std::string& directory = "" );
+    // Map the file into memory and parse it in place. Returns NULL if the file cannot be read
+    Camera* parseSceneFile( const char* filename );
 }
 
 #endif // SILENCE_PARSESCENE
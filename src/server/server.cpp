@@ -0,0 +1,423 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Server class methods
+// Part of Silence, an experimental rendering engine
+
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <omp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../core/aux.h"
+#include "../core/camera.h"
+#include "../core/image.h"
+#include "../core/renderer.h"
+#include "../core/scene.h"
+
+#include "../parser/parsejob.h"
+#include "../parser/parsescene.h"
+
+namespace Silence {
+
+    typedef std::chrono::steady_clock Clock;
+
+    class Server::Client {
+    public:
+        Client( std::istream* is, std::ostream* os )
+            : is( is )
+            , os( os )
+            , fd( -1 )
+            , buffer()
+            , pending( 0 )
+        { }
+        explicit Client( int fd )
+            : is( NULL )
+            , os( NULL )
+            , fd( fd )
+            , buffer()
+            , pending( 0 )
+        { }
+        ~Client()
+        {
+            if ( 0 <= fd )
+                close( fd );
+        }
+
+        bool readLine( std::string& line );
+        void reply( const std::string& line );
+
+        // Keep track of the Jobs still in flight
+        void started()
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            ++pending;
+        }
+        void finished()
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            if ( !--pending )
+                idle.notify_all();
+        }
+        void waitIdle()
+        {
+            std::unique_lock< std::mutex > lock( mutex );
+            idle.wait( lock, [this]{ return !pending; } );
+        }
+
+    private:
+        std::istream*           is;
+        std::ostream*           os;
+        int                     fd;
+        std::string             buffer; // Received but not yet consumed from the socket
+        std::mutex              mutex;
+        std::condition_variable idle;
+        int                     pending;
+    };
+
+    bool Server::Client::readLine( std::string& line )
+    {
+        if ( is )
+            return static_cast< bool >( std::getline(*is, line) );
+        while ( true )
+        {
+            const size_t newline = buffer.find( '\n' );
+            if ( std::string::npos != newline )
+            {
+                line = buffer.substr( 0, newline );
+                buffer.erase( 0, newline + 1 );
+                return true;
+            }
+            char chunk[4096];
+            const ssize_t received = recv( fd, chunk, sizeof(chunk), 0 );
+            if ( received < 0 && EINTR == errno )
+                continue;
+            if ( received <= 0 )
+            {
+                // The last line may not have been terminated
+                line.swap( buffer );
+                buffer.clear();
+                return !line.empty();
+            }
+            buffer.append( chunk, received );
+        }
+    }
+
+    void Server::Client::reply( const std::string& line )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        if ( os )
+        {
+            *os << line << std::endl;
+            return;
+        }
+        const std::string message = line + '\n';
+        for ( size_t sent = 0; sent < message.size(); )
+        {
+            const ssize_t result = send( fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL );
+            if ( result < 0 && EINTR == errno )
+                continue;
+            if ( result <= 0 )
+                return; // The client has gone away, nobody to tell
+            sent += result;
+        }
+    }
+
+    struct Server::Entry {
+        Entry()
+            : camera( NULL )
+            , renderer( NULL )
+            , mutex()
+            , loaded( false )
+            , error()
+        { }
+        ~Entry()
+        {
+            delete renderer;
+            if ( camera )
+            {
+                delete camera->getScene();
+                delete camera;
+            }
+        }
+
+        Camera*     camera;   // As defined in the scene file
+        Renderer*   renderer; // Holds the Zone forest
+        std::mutex  mutex;    // Held while the Scene is loaded
+        bool        loaded;
+        std::string error;
+    };
+
+    // Quote a string for JSON output
+    static std::string quote( const std::string& string )
+    {
+        std::ostringstream oss;
+        oss << '"';
+        for ( std::string::const_iterator c = string.begin(); c != string.end(); c++ )
+        {
+            if      ( '"'  == *c ) oss << "\\\"";
+            else if ( '\\' == *c ) oss << "\\\\";
+            else if ( '\n' == *c ) oss << "\\n";
+            else if ( (unsigned char)*c < 0x20 ) oss << ' ';
+            else                   oss << *c;
+        }
+        oss << '"';
+        return oss.str();
+    }
+
+    Server::Server( const Job& defaults, int workerCount, int cacheSize )
+        : defaults( defaults )
+        , cacheSize( std::max(1, cacheSize) )
+        , workers()
+        , tasks()
+        , tasksMutex()
+        , tasksQueued()
+        , stopping( false )
+        , entries()
+        , entryIndex()
+        , entriesMutex()
+    {
+        workerCount = std::max( 1, workerCount );
+        // Share the cores between the Jobs running side by side
+        const int threadsPerWorker = std::max( 1, omp_get_max_threads() / workerCount );
+        for ( int i = 0; i < workerCount; ++i )
+            workers.push_back( std::thread( &Server::work, this, threadsPerWorker ) );
+        if ( modeFlags.verbose )
+            std::cerr << "Server: started " << workerCount << " worker(s) with " << threadsPerWorker << " thread(s) each." << std::endl;
+    }
+
+    Server::~Server()
+    {
+        {
+            std::lock_guard< std::mutex > lock( tasksMutex );
+            stopping = true;
+        }
+        tasksQueued.notify_all();
+        for ( std::vector< std::thread >::iterator worker = workers.begin(); worker != workers.end(); worker++ )
+            worker->join();
+    }
+
+    void Server::serve( std::istream& is, std::ostream& os )
+    {
+        std::shared_ptr< Client > client = std::make_shared< Client >( &is, &os );
+        serveClient( client );
+        client->waitIdle();
+    }
+
+    void Server::listen( const std::string& socketPath )
+    {
+        sockaddr_un address;
+        memset( &address, 0, sizeof(address) );
+        address.sun_family = AF_UNIX;
+        if ( sizeof(address.sun_path) <= socketPath.size() )
+            throw std::string( "socket path is too long: '" + socketPath + "'" );
+        strcpy( address.sun_path, socketPath.c_str() );
+
+        // Clean up after an earlier Server, but don't clobber anything else
+        struct stat status;
+        if ( !stat(socketPath.c_str(), &status) && S_ISSOCK(status.st_mode) )
+            unlink( socketPath.c_str() );
+
+        const int listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+        if ( listener < 0 )
+            throw std::string( "cannot create socket: " ) + strerror( errno );
+        if ( bind(listener, (const sockaddr*)&address, sizeof(address)) || ::listen(listener, 16) )
+        {
+            const std::string error = strerror( errno );
+            close( listener );
+            throw "cannot listen at '" + socketPath + "': " + error;
+        }
+        if ( modeFlags.verbose )
+            std::cerr << "Server: listening at '" << socketPath << "'." << std::endl;
+        while ( true )
+        {
+            const int fd = accept( listener, NULL, NULL );
+            if ( fd < 0 )
+            {
+                if ( EINTR == errno || ECONNABORTED == errno )
+                    continue;
+                const std::string error = strerror( errno );
+                close( listener );
+                throw "cannot accept connection: " + error;
+            }
+            // The connection closes once its last Job has been replied to
+            std::thread( &Server::serveClient, this, std::make_shared< Client >(fd) ).detach();
+        }
+    }
+
+    // Parse Jobs line by line and queue them up
+    void Server::serveClient( std::shared_ptr< Client > client )
+    {
+        std::string line;
+        while ( client->readLine(line) )
+        {
+            if ( std::string::npos == line.find_first_not_of(" \t\r") )
+                continue;
+            Task task;
+            task.job    = defaults;
+            task.client = client;
+            try {
+                std::istringstream iss( line );
+                parseJob( iss, task.job );
+            }
+            catch( const std::string& e ) {
+                client->reply( "{ \"status\": \"error\", \"message\": " + quote(e) + " }" );
+                continue;
+            }
+            client->started();
+            {
+                std::lock_guard< std::mutex > lock( tasksMutex );
+                tasks.push_back( task );
+            }
+            tasksQueued.notify_one();
+        }
+    }
+
+    void Server::work( int threads )
+    {
+        omp_set_num_threads( threads );
+        while ( true )
+        {
+            Task task;
+            {
+                std::unique_lock< std::mutex > lock( tasksMutex );
+                tasksQueued.wait( lock, [this]{ return stopping || !tasks.empty(); } );
+                if ( tasks.empty() )
+                    return;
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            run( task );
+            task.client->finished();
+        }
+    }
+
+    void Server::run( const Task& task )
+    {
+        const Job& job = task.job;
+        const Clock::time_point start = Clock::now();
+        std::ostringstream reply;
+        reply << "{ ";
+        if ( !job.id.empty() )
+            reply << "\"id\": " << quote( job.id ) << ", ";
+        try {
+            bool cached;
+            const std::shared_ptr< Entry > entry = lookup( job, cached );
+            Camera camera( entry->camera->getScene() );
+            camera.setPose( job.camera ? *job.camera : *entry->camera );
+            entry->renderer->rasterize( &camera, job.level, job.gamma );
+            std::ofstream ofs( job.outFilename.c_str(), std::ios::binary );
+            if ( !ofs.is_open() )
+                throw "cannot write file at '" + job.outFilename + "'";
+            camera.writePixels( ofs, imageFormat(job.outFilename) );
+            const double seconds = std::chrono::duration< double >( Clock::now() - start ).count();
+            reply << "\"status\": \"ok\", \"output\": " << quote( job.outFilename )
+                  << ", \"cached\": " << (cached ? "true" : "false") << ", \"seconds\": " << seconds;
+        }
+        catch( const std::string& e ) {
+            reply << "\"status\": \"error\", \"message\": " << quote( e );
+        }
+        reply << " }";
+        task.client->reply( reply.str() );
+    }
+
+    // Find the Scene the Job asks for, loading it and building its Zones if it isn't resident yet
+    std::shared_ptr< Server::Entry > Server::lookup( const Job& job, bool& cached )
+    {
+        // The Zone forest depends on these settings too
+        std::ostringstream oss;
+        oss << job.sceneFilename << '\n' << job.depth << '\n' << job.level << '\n' << job.cutoff;
+        const std::string key = oss.str();
+
+        std::shared_ptr< Entry > entry;
+        {
+            std::lock_guard< std::mutex > lock( entriesMutex );
+            const std::map< std::string, EntryList::iterator >::iterator found = entryIndex.find( key );
+            if ( entryIndex.end() != found )
+            {
+                entries.splice( entries.begin(), entries, found->second );
+                entry = found->second->second;
+            }
+            else
+            {
+                entry = std::make_shared< Entry >();
+                entries.push_front( std::make_pair(key, entry) );
+                entryIndex[key] = entries.begin();
+                while ( (int)entries.size() > cacheSize )
+                {
+                    // Jobs still using the evicted Scene hold on to it until they're done
+                    if ( modeFlags.verbose )
+                        std::cerr << "Server: evicting '" << entries.back().first.substr( 0, entries.back().first.find('\n') ) << "'." << std::endl;
+                    entryIndex.erase( entries.back().first );
+                    entries.pop_back();
+                }
+            }
+        }
+
+        std::lock_guard< std::mutex > lock( entry->mutex );
+        cached = entry->loaded;
+        if ( !entry->loaded && entry->error.empty() )
+        {
+            const Clock::time_point start = Clock::now();
+            try {
+                entry->camera = parseSceneFile( job.sceneFilename.c_str() );
+                if ( !entry->camera )
+                    entry->error = "cannot read file at '" + job.sceneFilename + "'";
+            }
+            catch( const std::string& e ) {
+                entry->error = e;
+            }
+            if ( !entry->error.empty() )
+            {
+                // Don't keep the failure around, the file may be fixed by the next Job
+                forget( key, entry );
+                throw entry->error;
+            }
+            entry->renderer = new Renderer( entry->camera->getScene() );
+            entry->renderer->build( 0, job.depth, job.level, job.cutoff );
+            entry->loaded = true;
+            if ( modeFlags.verbose )
+                std::cerr << "Server: loaded '" << job.sceneFilename << "' in "
+                          << std::chrono::duration< double >( Clock::now() - start ).count() << " s." << std::endl;
+        }
+        if ( !entry->error.empty() )
+            throw entry->error;
+        return entry;
+    }
+
+    void Server::forget( const std::string& key, const std::shared_ptr< Entry >& entry )
+    {
+        std::lock_guard< std::mutex > lock( entriesMutex );
+        const std::map< std::string, EntryList::iterator >::iterator found = entryIndex.find( key );
+        if ( entryIndex.end() == found || found->second->second != entry )
+            return; // Already evicted
+        entries.erase( found->second );
+        entryIndex.erase( found );
+    }
+
+}
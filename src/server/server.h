@@ -0,0 +1,119 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Server: a long-lived process rendering jobs against resident Scenes
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_SERVER
+#define SILENCE_SERVER
+
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Silence {
+
+    class Camera;
+    class Renderer;
+
+    // A single image to render, read from one line of JSON
+    struct Job {
+        Job()
+            : id()
+            , sceneFilename()
+            , camera()
+            , depth( 6 )
+            , level( -1 )
+            , cutoff( 0 )
+            , gamma( 1 )
+            , outFilename()
+        { }
+
+        std::string                     id;            // Echoed back in the reply, if any
+        std::string                     sceneFilename; // Also identifies the Scene in the cache
+        std::shared_ptr< const Camera > camera;        // Pose only; the Scene's own Camera is used if unset
+        int                             depth;
+        int                             level;
+        double                          cutoff;
+        double                          gamma;
+        std::string                     outFilename;
+    };
+
+    class Server {
+
+        // Where Jobs come from and replies go to: a stream pair or a socket
+        class Client;
+        // A parsed Scene with its Zone forest, shared by all Jobs that ask for the same one
+        struct Entry;
+
+        struct Task {
+            Job                       job;
+            std::shared_ptr< Client > client;
+        };
+
+    public:
+        // Jobs are filled in from 'defaults' where they leave a setting out
+        Server( const Job& defaults, int workerCount, int cacheSize );
+        ~Server();
+
+        // Take Jobs from a stream and reply on another one until the input ends
+        void serve( std::istream& is, std::ostream& os );
+        // Take Jobs from every connection to a Unix domain socket. Doesn't return unless an error occurs
+        void listen( const std::string& socketPath );
+
+    private:
+        Server( const Server& );
+        Server& operator=( const Server& );
+
+        void serveClient( std::shared_ptr< Client > client );
+        void work( int threads );
+        void run( const Task& task );
+
+        std::shared_ptr< Entry > lookup( const Job& job, bool& cached );
+        void                     forget( const std::string& key, const std::shared_ptr< Entry >& entry );
+
+    private:
+        const Job defaults;
+        const int cacheSize;
+
+        // Thread pool
+        std::vector< std::thread > workers;
+        std::deque< Task >         tasks;
+        std::mutex                 tasksMutex;
+        std::condition_variable    tasksQueued;
+        bool                       stopping;
+
+        // LRU cache of Scenes, most recently used first
+        typedef std::list< std::pair< std::string, std::shared_ptr< Entry > > > EntryList;
+        EntryList                                    entries;
+        std::map< std::string, EntryList::iterator > entryIndex;
+        std::mutex                                   entriesMutex;
+    };
+
+}
+
+#endif // SILENCE_SERVER
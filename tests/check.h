@@ -0,0 +1,51 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Minimal checks shared by the tests: failures are reported and counted, and the count
+// decides the exit status of the test program
+// Part of Silence, an experimental rendering engine
+
+#ifndef SILENCE_TESTS_CHECK
+#define SILENCE_TESTS_CHECK
+
+#include <iostream>
+
+static int failures = 0;
+
+#define CHECK( condition ) \
+    do { \
+        if ( !(condition) ) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            ++failures; \
+        } \
+    } while ( 0 )
+
+// Print a one line summary and return the exit status for main
+static int report( const char* name )
+{
+    if ( failures )
+        std::cerr << name << ": " << failures << " check(s) failed" << std::endl;
+    else
+        std::cerr << name << ": OK" << std::endl;
+    return failures ? 1 : 0;
+}
+
+#endif // SILENCE_TESTS_CHECK
+
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Tests of compiled scene files
+// Part of Silence, an experimental rendering engine
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "core/camera.h"
+#include "core/scene.h"
+#include "parser/compiledscene.h"
+#include "parser/parsescene.h"
+
+#include "check.h"
+
+using namespace Silence;
+
+// One of every kind of part, and a Mesh with an instance of it
+static const char* const sceneText =
+    "{ \"scene\": ["
+    "  { \"lightpoint\":  { \"emission\": [1, 1, 1], \"point\": [0, 5, 0] } },"
+    "  { \"lightsphere\": { \"emission\": [1, 1, 1], \"center\": [2, 5, 0], \"radius\": 0.5 } },"
+    "  { \"plane\":       { \"normal\": [0, 1, 0], \"offset\": -1 } },"
+    "  { \"thing\": [ { \"sphere\": { \"center\": [0, 0, 0], \"radius\": 1 } },"
+    "                 { \"triangle\": { \"points\": [ [0, 0, 0], [1, 0, 0], [0, 1, 0] ] } } ] },"
+    "  { \"name\": \"wedge\", \"mesh\": { \"vertices\": [ [0, 0, 0], [1, 0, 0], [0, 1, 0], [0, 0, 1] ],"
+    "                                   \"faces\": [ [0, 1, 2], [0, 1, 3], [0, 2, 3] ] } },"
+    "  { \"instance\": { \"of\": \"wedge\", \"translate\": [3, 0, 0] } }"
+    "],"
+    "\"camera\": { \"viewpoint\": [0, 0, 20],"
+    "              \"screen\": [ [-1, 1, 19], [1, 1, 19], [-1, -1, 19], [1, -1, 19] ],"
+    "              \"gridresolution\": [16, 16] } }";
+
+static int loaded = 0, rejected = 0;
+
+// A broken file must either load or be turned down with a message, nothing else
+static void load( const std::string& data )
+{
+    try {
+        Camera* camera = loadCompiledScene( data.data(), data.size() );
+        delete camera->getScene();
+        delete camera;
+        ++loaded;
+    }
+    catch( const std::string& ) {
+        ++rejected;
+    }
+    catch( ... ) {
+        CHECK( !"loadCompiledScene threw something other than a message" );
+    }
+}
+
+int main()
+{
+    Camera* camera = parseScene( sceneText, strlen(sceneText) );
+    CHECK( camera );
+    if ( !camera )
+        return report( "compiledscene" );
+    std::ostringstream oss;
+    compileScene( oss, *camera );
+    const std::string compiled = oss.str();
+    delete camera->getScene();
+    delete camera;
+
+    load( compiled );
+    CHECK( 1 == loaded );
+
+    // Cut short anywhere
+    for ( size_t size = 0; size < compiled.size(); size += 4 )
+        load( compiled.substr(0, size) );
+    CHECK( 1 == loaded );
+
+    // Every word overwritten by values that make good indices and counts once they're corrupted
+    const uint32_t values[] = { 0, 1, 2, 0x7ffffff0, 0xfffffffe, 0xffffffff };
+    for ( size_t offset = 0; offset + 4 <= compiled.size(); offset += 4 )
+        for ( size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i )
+        {
+            std::string corrupted( compiled );
+            memcpy( &corrupted[offset], &values[i], 4 );
+            load( corrupted );
+        }
+    CHECK( 0 < rejected );
+
+    return report( "compiledscene" );
+}
+
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2016 Dániel Arató
+ *
+ * This file is part of Silence.
+ *
+ * Silence is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Silence is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Silence.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Tests of the library interface
+// Part of Silence, an experimental rendering engine
+
+#include <vector>
+
+#include "lib/silence.h"
+
+#include "check.h"
+
+using namespace Silence;
+
+static bool black( const float* pixels, size_t count )
+{
+    for ( size_t i = 0; i < count; ++i )
+        if ( pixels[i] )
+            return false;
+    return true;
+}
+
+int main()
+{
+    Camera* loaded = parseSceneFile( "scenes/triangletest.json" );
+    CHECK( loaded );
+    if ( !loaded )
+        return report( "library" );
+    const Scene* scene = loaded->getScene();
+
+    // Small copies of the loaded Camera keep the renders quick
+    Camera added( scene ), other( scene ), foreign( scene );
+    added  .setPose( *loaded, 8 );
+    other  .setPose( *loaded, 8 );
+    foreign.setPose( *loaded, 8 );
+    const size_t count = 3 * (size_t)added.getGridwidth() * added.getGridheight();
+    std::vector< float > pixels( count, 0.0f );
+
+    Renderer renderer( scene );
+    renderer.addCamera( &added );
+    renderer.addCamera( &other );
+    CHECK( renderer.findCamera( &added ) == &added );
+    CHECK( !renderer.findCamera( &foreign ) );
+
+    // A Camera the Renderer doesn't know about is refused
+    CHECK( !renderToBuffer( renderer, foreign, &pixels[0], 2 ) );
+    CHECK( black( &pixels[0], count ) );
+
+    // Only the Camera asked for is rendered
+    CHECK( renderToBuffer( renderer, added, &pixels[0], 2 ) );
+    CHECK( !black( &pixels[0], count ) );
+    CHECK( black( other.getImage(), 3 * (size_t)other.getStride() * other.getGridheight() ) );
+    CHECK( 0 < getStats( renderer ).zones );
+
+    delete scene;
+    delete loaded;
+    return report( "library" );
+}
+